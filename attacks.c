@@ -0,0 +1,360 @@
+#include <stdbool.h>
+#include <stddef.h>
+// build with -DATTACKS_MAILBOX to walk the rays on every lookup instead of
+// keeping the magic tables around
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(ATTACKS_MAILBOX)
+#include <immintrin.h>
+#define ATTACKS_PEXT
+#endif
+#include "bitboard.h"
+#include "attacks.h"
+
+struct magic
+{
+  uint64_t mask;
+  uint64_t magic;
+  uint64_t *attacks;
+  int shift;
+};
+
+// rooks need at most 2^12 entries per square, bishops 2^9,
+// packed back to back these are the totals over all squares
+#define ROOK_TABLE_SIZE 102400
+#define BISHOP_TABLE_SIZE 5248
+
+static uint64_t pawn_attacks[2][64];
+static uint64_t knight_attacks[64];
+static uint64_t king_attacks[64];
+static uint64_t between[64][64];
+static uint64_t line[64][64];
+
+// the board padded to 10x12 with off-board squares set to -1, stepping from
+// any real square by any piece offset lands inside the padding, so walking
+// a ray only has to look for the sentinel
+static const int mailbox[120] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1,  0,  1,  2,  3,  4,  5,  6,  7, -1,
+  -1,  8,  9, 10, 11, 12, 13, 14, 15, -1,
+  -1, 16, 17, 18, 19, 20, 21, 22, 23, -1,
+  -1, 24, 25, 26, 27, 28, 29, 30, 31, -1,
+  -1, 32, 33, 34, 35, 36, 37, 38, 39, -1,
+  -1, 40, 41, 42, 43, 44, 45, 46, 47, -1,
+  -1, 48, 49, 50, 51, 52, 53, 54, 55, -1,
+  -1, 56, 57, 58, 59, 60, 61, 62, 63, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+static const int mailbox64[64] = {
+  21, 22, 23, 24, 25, 26, 27, 28,
+  31, 32, 33, 34, 35, 36, 37, 38,
+  41, 42, 43, 44, 45, 46, 47, 48,
+  51, 52, 53, 54, 55, 56, 57, 58,
+  61, 62, 63, 64, 65, 66, 67, 68,
+  71, 72, 73, 74, 75, 76, 77, 78,
+  81, 82, 83, 84, 85, 86, 87, 88,
+  91, 92, 93, 94, 95, 96, 97, 98
+};
+
+static const int rook_directions[4] = {-10, 1, 10, -1};
+static const int bishop_directions[4] = {-11, -9, 9, 11};
+
+#ifdef ATTACKS_MAILBOX
+static uint64_t rook_attacks_mailbox(int square, uint64_t occupancy);
+static uint64_t bishop_attacks_mailbox(int square, uint64_t occupancy);
+
+static uint64_t (*rook_attacks)(int square, uint64_t occupancy) = rook_attacks_mailbox;
+static uint64_t (*bishop_attacks)(int square, uint64_t occupancy) = bishop_attacks_mailbox;
+#else
+static struct magic rook_magics[64];
+static struct magic bishop_magics[64];
+static uint64_t rook_table[ROOK_TABLE_SIZE];
+static uint64_t bishop_table[BISHOP_TABLE_SIZE];
+
+static uint64_t rook_attacks_magic(int square, uint64_t occupancy);
+static uint64_t bishop_attacks_magic(int square, uint64_t occupancy);
+
+// selected by `attacks_init` depending on the cpu we run on
+static bool use_pext = false;
+static uint64_t (*rook_attacks)(int square, uint64_t occupancy) = rook_attacks_magic;
+static uint64_t (*bishop_attacks)(int square, uint64_t occupancy) = bishop_attacks_magic;
+#endif
+
+#ifndef ATTACKS_MAILBOX
+// found by trying random sparse numbers until every subset of the
+// relevant occupancy maps to an index without a destructive collision
+static const uint64_t rook_magic_numbers[64] = {
+  0x1080004008801020, 0x0840092002c03000, 0x1900200010400900, 0x0880100008000480,
+  0x4200100420080200, 0x8100020100080400, 0x0200040110886200, 0x0200008040220411,
+  0x0404800084400220, 0x0000401000402000, 0x0086001081220440, 0x0408800800100280,
+  0x000a001201040820, 0x8848800200840080, 0x4001000100040200, 0x0442000102105084,
+  0x9080010020804100, 0x0040404000201009, 0x0000808010002009, 0x2200090021d00100,
+  0x0008008008040080, 0x0004004002010040, 0x0011040008015042, 0x00000a0001768104,
+  0x0000800080204009, 0x2010004140002001, 0x9800200280100080, 0x1000100080080080,
+  0x0442000a00049020, 0x2100040080020080, 0x0800120400900148, 0x0010040a00128541,
+  0x2800804000800030, 0x1010002000400041, 0x4000200011004100, 0x0610008410800800,
+  0x0400802402800800, 0xc100020080800400, 0x0002000802000401, 0x0182085882000401,
+  0x0220204000808000, 0x2860100040024022, 0x0001002004110040, 0x99101042000a0020,
+  0x0004080004008080, 0x0010040002008080, 0x2012004881020004, 0x8300842444820011,
+  0x0088403882010200, 0x0820400080210100, 0x0110910040a00300, 0x0801100280080480,
+  0x0242009008200600, 0x1002000489500200, 0x0040800200010080, 0x0091800041000080,
+  0x0000209300488001, 0x04c1002414824001, 0x020020000b001041, 0x7000100004200901,
+  0x8002002004100802, 0x30010002084c0007, 0x0888221800813004, 0x4000002840840112
+};
+
+static const uint64_t bishop_magic_numbers[64] = {
+  0xa010041108003100, 0x006082020a002900, 0x6810010619200000, 0x08281a0520000408,
+  0x0001104001000400, 0x0018901008048400, 0x00040a0210245280, 0x000200210808a402,
+  0x9140048410821200, 0x0800091010820041, 0x20504804832202c0, 0x0100091401081000,
+  0x8021011140000012, 0x0810020804450400, 0x208b0542109008a2, 0x0080084a08040204,
+  0x0040e2a80811244c, 0x2505022008008108, 0x0430220100420040, 0x010a040420220040,
+  0x1105000290400000, 0x0093001200822120, 0x4000a62048043004, 0x280120048a015004,
+  0x006090002a020814, 0x44042000240800d0, 0x01102800040a4400, 0x1004080080220040,
+  0x0001001011004024, 0x0010044000805040, 0x0914041200820100, 0x0004821012821480,
+  0x0024040500c05021, 0x0088611002080200, 0x0116080a00040020, 0x4000020080080080,
+  0x2450450140840040, 0x0000880201484100, 0x0222020404020092, 0x8081110600002e00,
+  0x2842101105000801, 0x1100809008001025, 0x00020202221c0400, 0x0422014022009020,
+  0x0210046102100c00, 0xc004008082029102, 0x00aa461801101200, 0x0404080080201108,
+  0x020542108c205002, 0x0410544804100100, 0x0040910841100000, 0x0400200042021100,
+  0x00004204850400c0, 0x0200100410a42102, 0x1040020801210102, 0x0805040410420000,
+  0x2884804130100200, 0x800c262201242000, 0x1058000194108800, 0x0014221054420204,
+  0x0104000012a02200, 0x0200881003300100, 0x0140400202840100, 0x0402020801010201
+};
+
+#endif
+
+static uint64_t step_attacks(int square, const int offsets[], int offset_count)
+{
+  uint64_t attacks = 0;
+  for (int i = 0; i < offset_count; ++i)
+  {
+    int to = mailbox[mailbox64[square] + offsets[i]];
+    if (to != -1)
+    {
+      attacks |= BITBOARD_SQUARE(to);
+    }
+  }
+  return attacks;
+}
+
+static uint64_t ray_attacks(int square, uint64_t occupancy, const int directions[4])
+{
+  uint64_t attacks = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    for (int index = mailbox64[square] + directions[i]; mailbox[index] != -1; index += directions[i])
+    {
+      uint64_t bit = BITBOARD_SQUARE(mailbox[index]);
+      attacks |= bit;
+      if (occupancy & bit)
+      {
+        // blocked, the blocker itself is still attacked
+        break;
+      }
+    }
+  }
+  return attacks;
+}
+
+#ifndef ATTACKS_MAILBOX
+static uint64_t relevant_mask(int square, const int directions[4])
+{
+  // squares whose occupancy affects the attacks, the last square
+  // of every ray is attacked no matter what so it is left out
+  uint64_t mask = 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    for (int index = mailbox64[square] + directions[i]; mailbox[index] != -1 && mailbox[index + directions[i]] != -1; index += directions[i])
+    {
+      mask |= BITBOARD_SQUARE(mailbox[index]);
+    }
+  }
+  return mask;
+}
+
+#ifdef ATTACKS_PEXT
+__attribute__((target("bmi2"))) static uint64_t pext(uint64_t occupancy, uint64_t mask)
+{
+  return _pext_u64(occupancy, mask);
+}
+
+__attribute__((target("bmi2"))) static uint64_t rook_attacks_pext(int square, uint64_t occupancy)
+{
+  const struct magic *magic = &rook_magics[square];
+  return magic->attacks[_pext_u64(occupancy, magic->mask)];
+}
+
+__attribute__((target("bmi2"))) static uint64_t bishop_attacks_pext(int square, uint64_t occupancy)
+{
+  const struct magic *magic = &bishop_magics[square];
+  return magic->attacks[_pext_u64(occupancy, magic->mask)];
+}
+
+static bool cpu_has_fast_pext(void)
+{
+  __builtin_cpu_init();
+  if (!__builtin_cpu_supports("bmi2"))
+  {
+    return false;
+  }
+  // zen 1 and zen 2 implement pext in microcode, magics are faster there
+  return !__builtin_cpu_is("znver1") && !__builtin_cpu_is("znver2");
+}
+#endif
+
+static void init_magics(struct magic magics[64], const uint64_t magic_numbers[64], uint64_t *table, const int directions[4])
+{
+  for (int square = 0; square < 64; ++square)
+  {
+    struct magic *magic = &magics[square];
+    magic->mask = relevant_mask(square, directions);
+    magic->magic = magic_numbers[square];
+    magic->shift = 64 - bitboard_count(magic->mask);
+    magic->attacks = table;
+    // enumerate all subsets of the mask
+    uint64_t occupancy = 0;
+    do
+    {
+      uint64_t index = (occupancy * magic->magic) >> magic->shift;
+#ifdef ATTACKS_PEXT
+      if (use_pext)
+      {
+        // both backends need 2^bits entries, only the order differs
+        index = pext(occupancy, magic->mask);
+      }
+#endif
+      magic->attacks[index] = ray_attacks(square, occupancy, directions);
+      occupancy = (occupancy - magic->mask) & magic->mask;
+    } while (occupancy != 0);
+    table += 1 << (64 - magic->shift);
+  }
+}
+#endif
+
+void attacks_init(void)
+{
+  static bool initialized = false;
+  if (initialized)
+  {
+    return;
+  }
+  static const int knight_offsets[8] = {-21, -19, -12, -8, 8, 12, 19, 21};
+  static const int king_offsets[8] = {-11, -10, -9, -1, 1, 9, 10, 11};
+  // white pawns move towards rank 0, black pawns towards rank 7
+  static const int pawn_offsets[2][2] = {{-11, -9}, {9, 11}};
+  for (int square = 0; square < 64; ++square)
+  {
+    pawn_attacks[PIECE_WHITE][square] = step_attacks(square, pawn_offsets[PIECE_WHITE], 2);
+    pawn_attacks[PIECE_BLACK][square] = step_attacks(square, pawn_offsets[PIECE_BLACK], 2);
+    knight_attacks[square] = step_attacks(square, knight_offsets, 8);
+    king_attacks[square] = step_attacks(square, king_offsets, 8);
+  }
+#ifdef ATTACKS_PEXT
+  if (cpu_has_fast_pext())
+  {
+    use_pext = true;
+    rook_attacks = rook_attacks_pext;
+    bishop_attacks = bishop_attacks_pext;
+  }
+#endif
+#ifndef ATTACKS_MAILBOX
+  init_magics(rook_magics, rook_magic_numbers, rook_table, rook_directions);
+  init_magics(bishop_magics, bishop_magic_numbers, bishop_table, bishop_directions);
+#endif
+  for (int from = 0; from < 64; ++from)
+  {
+    for (int to = 0; to < 64; ++to)
+    {
+      uint64_t (*slider)(int square, uint64_t occupancy) = NULL;
+      if (rook_attacks(from, 0) & BITBOARD_SQUARE(to))
+      {
+        slider = rook_attacks;
+      }
+      else if (bishop_attacks(from, 0) & BITBOARD_SQUARE(to))
+      {
+        slider = bishop_attacks;
+      }
+      if (slider != NULL)
+      {
+        between[from][to] = slider(from, BITBOARD_SQUARE(to)) & slider(to, BITBOARD_SQUARE(from));
+        line[from][to] = (slider(from, 0) & slider(to, 0)) | BITBOARD_SQUARE(from) | BITBOARD_SQUARE(to);
+      }
+    }
+  }
+  initialized = true;
+}
+
+uint64_t attacks_pawn(enum piece_color color, int square)
+{
+  return pawn_attacks[color][square];
+}
+
+uint64_t attacks_knight(int square)
+{
+  return knight_attacks[square];
+}
+
+uint64_t attacks_king(int square)
+{
+  return king_attacks[square];
+}
+
+#ifdef ATTACKS_MAILBOX
+static uint64_t rook_attacks_mailbox(int square, uint64_t occupancy)
+{
+  return ray_attacks(square, occupancy, rook_directions);
+}
+
+static uint64_t bishop_attacks_mailbox(int square, uint64_t occupancy)
+{
+  return ray_attacks(square, occupancy, bishop_directions);
+}
+
+const char *attacks_backend(void)
+{
+  return "mailbox";
+}
+#else
+static uint64_t rook_attacks_magic(int square, uint64_t occupancy)
+{
+  const struct magic *magic = &rook_magics[square];
+  return magic->attacks[((occupancy & magic->mask) * magic->magic) >> magic->shift];
+}
+
+static uint64_t bishop_attacks_magic(int square, uint64_t occupancy)
+{
+  const struct magic *magic = &bishop_magics[square];
+  return magic->attacks[((occupancy & magic->mask) * magic->magic) >> magic->shift];
+}
+
+const char *attacks_backend(void)
+{
+  return use_pext ? "pext" : "magic";
+}
+#endif
+
+uint64_t attacks_rook(int square, uint64_t occupancy)
+{
+  return rook_attacks(square, occupancy);
+}
+
+uint64_t attacks_bishop(int square, uint64_t occupancy)
+{
+  return bishop_attacks(square, occupancy);
+}
+
+uint64_t attacks_queen(int square, uint64_t occupancy)
+{
+  return attacks_rook(square, occupancy) | attacks_bishop(square, occupancy);
+}
+
+uint64_t attacks_between(int from, int to)
+{
+  return between[from][to];
+}
+
+uint64_t attacks_line(int from, int to)
+{
+  return line[from][to];
+}
@@ -0,0 +1,22 @@
+#ifndef ATTACKS_H
+#define ATTACKS_H
+
+#include <stdint.h>
+#include "board.h"
+
+void attacks_init(void);
+const char *attacks_backend(void);
+
+uint64_t attacks_pawn(enum piece_color color, int square);
+uint64_t attacks_knight(int square);
+uint64_t attacks_king(int square);
+uint64_t attacks_rook(int square, uint64_t occupancy);
+uint64_t attacks_bishop(int square, uint64_t occupancy);
+uint64_t attacks_queen(int square, uint64_t occupancy);
+
+// squares strictly between two squares on a shared line, empty if they do not share one
+uint64_t attacks_between(int from, int to);
+// the whole line through two squares, empty if they do not share one
+uint64_t attacks_line(int from, int to);
+
+#endif
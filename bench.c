@@ -0,0 +1,301 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "attacks.h"
+#include "board.h"
+#include "timer.h"
+
+#define SAMPLES 20
+// each sample runs the corpus often enough to take about this long
+#define SAMPLE_SECONDS 0.05
+// a slowdown also has to be this many standard errors of the two runs together
+// before it counts, so a difference that is just noise is not taken for a regression
+#define DEVIATIONS 3.0
+#define DEFAULT_RESULTS "bench_results.tsv"
+#define DEFAULT_BASELINE "bench_baseline.tsv"
+#define DEFAULT_THRESHOLD 10.0
+
+struct bench_position
+{
+  const char *category;
+  const char *fen;
+};
+
+static const struct bench_position corpus[] = {
+  {"opening", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"},
+  {"opening", "rnbqkbnr/pp1ppppp/8/2p5/4P3/8/PPPP1PPP/RNBQKBNR w KQkq c6 0 2"},
+  {"opening", "r1bqkbnr/pppp1ppp/2n5/1B2p3/4P3/5N2/PPPP1PPP/RNBQK2R b KQkq - 3 3"},
+  {"middlegame", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"},
+  {"middlegame", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"},
+  {"middlegame", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8"},
+  {"endgame", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"},
+  {"endgame", "6k1/5ppp/8/8/8/8/5PPP/3R2K1 w - - 0 1"},
+  {"endgame", "8/5k2/8/3P4/8/8/5K2/8 w - - 0 1"},
+  {"check", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1"},
+  {"check", "rnb1kbnr/pppp1ppp/8/4p3/6Pq/5P2/PPPPP2P/RNBQKBNR w KQkq - 1 3"},
+  {"check", "r1bqkbnr/pppp1Qpp/2n5/4p3/2B1P3/8/PPPP1PPP/RNB1K1NR b KQkq - 0 4"},
+  {"check", "4k3/4q3/8/8/8/8/8/4K3 w - - 0 1"},
+};
+
+#define CORPUS_SIZE (int)(sizeof(corpus) / sizeof(corpus[0]))
+
+struct primitive
+{
+  const char *name;
+  // runs the primitive on one position, returns how many operations that was
+  int (*run)(struct position *position);
+};
+
+struct result
+{
+  const char *name;
+  double mean;
+  double deviation;
+  double min;
+  double median;
+};
+
+static struct position positions[CORPUS_SIZE];
+// legal moves of each position, generated once so `board_make_move` is timed on its own
+static struct move_list move_lists[CORPUS_SIZE];
+// keeps the compiler from dropping work whose result is otherwise unused
+static volatile uint64_t sink;
+
+static int run_legal_moves(struct position *position)
+{
+  uint64_t pieces = position->colors[position->current_color];
+  int calls = 0;
+  for (int square = 0; square < BOARD_SIZE * BOARD_SIZE; ++square)
+  {
+    if (pieces & ((uint64_t)1 << square))
+    {
+      struct move moves[32];
+      sink += board_get_legal_moves(position, square / BOARD_SIZE, square % BOARD_SIZE, moves);
+      ++calls;
+    }
+  }
+  return calls;
+}
+
+static int run_generate(struct position *position)
+{
+  struct move_list list;
+  sink += board_generate_moves(position, position->current_color, &list);
+  return 1;
+}
+
+static int run_in_check(struct position *position)
+{
+  sink += board_in_check(position, PIECE_WHITE);
+  sink += board_in_check(position, PIECE_BLACK);
+  return 2;
+}
+
+static int run_make_move(struct position *position)
+{
+  const struct move_list *list = &move_lists[position - positions];
+  for (int i = 0; i < list->count; ++i)
+  {
+    struct undo undo;
+    board_make_move(position, list->moves[i], &undo);
+    sink += position->key;
+    board_unmake_move(position, &undo);
+  }
+  return list->count;
+}
+
+static int run_status(struct position *position)
+{
+  sink += board_status(position, NULL, position->current_color);
+  return 1;
+}
+
+static const struct primitive primitives[] = {
+  {"board_get_legal_moves", run_legal_moves},
+  {"board_generate_moves", run_generate},
+  {"board_in_check", run_in_check},
+  {"board_make_move", run_make_move},
+  {"board_status", run_status},
+};
+
+#define PRIMITIVE_COUNT (int)(sizeof(primitives) / sizeof(primitives[0]))
+
+static double sample(const struct primitive *primitive, int iterations)
+{
+  // nanoseconds per operation over `iterations` passes through the corpus
+  uint64_t operations = 0;
+  double start = timer_now();
+  for (int i = 0; i < iterations; ++i)
+  {
+    for (int j = 0; j < CORPUS_SIZE; ++j)
+    {
+      operations += primitive->run(&positions[j]);
+    }
+  }
+  return (timer_now() - start) * 1e9 / operations;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+  double difference = *(const double *)a - *(const double *)b;
+  return (difference > 0) - (difference < 0);
+}
+
+static int calibrate(const struct primitive *primitive)
+{
+  // double the passes until one sample is long enough to time reliably
+  int iterations = 1;
+  double start = timer_now();
+  sample(primitive, iterations);
+  while (timer_now() - start < SAMPLE_SECONDS)
+  {
+    iterations *= 2;
+    start = timer_now();
+    sample(primitive, iterations);
+  }
+  return iterations;
+}
+
+static void measure(struct result results[PRIMITIVE_COUNT])
+{
+  int iterations[PRIMITIVE_COUNT];
+  for (int i = 0; i < PRIMITIVE_COUNT; ++i)
+  {
+    iterations[i] = calibrate(&primitives[i]);
+  }
+  // the primitives take turns, so a stretch where the machine is slower is
+  // spread over all of them instead of landing on whichever ran at the time
+  double samples[PRIMITIVE_COUNT][SAMPLES];
+  for (int j = 0; j < SAMPLES; ++j)
+  {
+    for (int i = 0; i < PRIMITIVE_COUNT; ++i)
+    {
+      samples[i][j] = sample(&primitives[i], iterations[i]);
+    }
+  }
+  for (int i = 0; i < PRIMITIVE_COUNT; ++i)
+  {
+    struct result *result = &results[i];
+    *result = (struct result){primitives[i].name, 0, 0, INFINITY, 0};
+    for (int j = 0; j < SAMPLES; ++j)
+    {
+      result->mean += samples[i][j] / SAMPLES;
+      result->min = fmin(result->min, samples[i][j]);
+    }
+    for (int j = 0; j < SAMPLES; ++j)
+    {
+      result->deviation += (samples[i][j] - result->mean) * (samples[i][j] - result->mean) / (SAMPLES - 1);
+    }
+    result->deviation = sqrt(result->deviation);
+    // a few samples disturbed by the rest of the machine do not move the median
+    qsort(samples[i], SAMPLES, sizeof(double), compare_samples);
+    result->median = (samples[i][(SAMPLES - 1) / 2] + samples[i][SAMPLES / 2]) / 2;
+  }
+}
+
+static bool write_results(const char *path, const struct result results[PRIMITIVE_COUNT])
+{
+  FILE *file = fopen(path, "w");
+  if (file == NULL)
+  {
+    return false;
+  }
+  fprintf(file, "# primitive\tns_per_op\tstddev\tmin\tmedian\n");
+  for (int i = 0; i < PRIMITIVE_COUNT; ++i)
+  {
+    fprintf(file, "%s\t%.3f\t%.3f\t%.3f\t%.3f\n", results[i].name, results[i].mean, results[i].deviation, results[i].min, results[i].median);
+  }
+  fclose(file);
+  return true;
+}
+
+static bool read_baseline(const char *path, const char *name, struct result *result)
+{
+  FILE *file = fopen(path, "r");
+  if (file == NULL)
+  {
+    return false;
+  }
+  char line[256];
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), file) != NULL)
+  {
+    char line_name[128];
+    found = line[0] != '#' && sscanf(line, "%127s %lf %lf %lf %lf", line_name, &result->mean, &result->deviation, &result->min, &result->median) == 5 && strcmp(line_name, name) == 0;
+  }
+  fclose(file);
+  return found;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *results_path = DEFAULT_RESULTS;
+  const char *baseline_path = DEFAULT_BASELINE;
+  double threshold = DEFAULT_THRESHOLD;
+  bool save_baseline = false;
+  int option;
+  while ((option = getopt(argc, argv, "o:b:r:s")) != -1)
+  {
+    switch (option)
+    {
+    case 'o':
+      results_path = optarg;
+      break;
+    case 'b':
+      baseline_path = optarg;
+      break;
+    case 'r':
+      threshold = atof(optarg);
+      break;
+    case 's':
+      save_baseline = true;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-o results] [-b baseline] [-r threshold percent] [-s]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  for (int i = 0; i < CORPUS_SIZE; ++i)
+  {
+    if (!board_from_fen(&positions[i], corpus[i].fen))
+    {
+      fprintf(stderr, "bad %s position: %s\n", corpus[i].category, corpus[i].fen);
+      return EXIT_FAILURE;
+    }
+    board_generate_moves(&positions[i], positions[i].current_color, &move_lists[i]);
+  }
+  struct result results[PRIMITIVE_COUNT];
+  bool regressed = false;
+  printf("attacks: %s\n\n", attacks_backend());
+  printf("%-24s %10s %10s %10s %10s %12s\n", "primitive", "ns/op", "stddev", "median", "base median", "base stddev");
+  measure(results);
+  for (int i = 0; i < PRIMITIVE_COUNT; ++i)
+  {
+    printf("%-24s %10.2f %10.2f %10.2f", results[i].name, results[i].mean, results[i].deviation, results[i].median);
+    struct result baseline;
+    if (!save_baseline && read_baseline(baseline_path, results[i].name, &baseline))
+    {
+      double change = (results[i].median / baseline.median - 1) * 100;
+      // the standard error of each run's average, not the spread of single samples
+      double noise = DEVIATIONS * sqrt((baseline.deviation * baseline.deviation + results[i].deviation * results[i].deviation) / SAMPLES);
+      bool slower = change > threshold && results[i].median - baseline.median > noise;
+      regressed = regressed || slower;
+      printf(" %10.2f %12.2f %+6.1f%%%s", baseline.median, baseline.deviation, change, slower ? " REGRESSION" : "");
+    }
+    printf("\n");
+  }
+  if (!write_results(results_path, results) || (save_baseline && !write_results(baseline_path, results)))
+  {
+    fprintf(stderr, "could not write results\n");
+    return EXIT_FAILURE;
+  }
+  if (regressed)
+  {
+    printf("\nslower than %s by more than %.1f%% and %.0f standard errors\n", baseline_path, threshold, DEVIATIONS);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
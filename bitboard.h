@@ -0,0 +1,29 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+
+// bit `rank * 8 + file` is set if the square is in the set
+#define BITBOARD_SQUARE(square) ((uint64_t)1 << (square))
+// every square of one rank or one file
+#define BITBOARD_RANK(rank) ((uint64_t)0xff << (8 * (rank)))
+#define BITBOARD_FILE(file) ((uint64_t)0x0101010101010101 << (file))
+
+static inline int bitboard_lsb(uint64_t bitboard)
+{
+  return __builtin_ctzll(bitboard);
+}
+
+static inline int bitboard_pop_lsb(uint64_t *bitboard)
+{
+  int square = __builtin_ctzll(*bitboard);
+  *bitboard &= *bitboard - 1;
+  return square;
+}
+
+static inline int bitboard_count(uint64_t bitboard)
+{
+  return __builtin_popcountll(bitboard);
+}
+
+#endif
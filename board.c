@@ -1,456 +1,1137 @@
 #include <assert.h>
+#include <ctype.h>
 #include <stdlib.h>
-#include "texture.h"
+#include <string.h>
+#include "attacks.h"
+#include "bitboard.h"
 #include "board.h"
 
-struct board board_init(SDL_Renderer *renderer, int x, int y, int width, int height)
-{
-  struct board board;
-  board.renderer = renderer;
-  board.x = x;
-  board.y = y;
-  board.square_width = width / BOARD_SIZE;
-  board.square_height = height / BOARD_SIZE;
-  board.en_passant_possible = false;
-  board.current_color = PIECE_WHITE;
-  board.squares[0] = (struct piece){PIECE_BLACK, PIECE_ROOK, false};
-  board.squares[1] = (struct piece){PIECE_BLACK, PIECE_KNIGHT, false};
-  board.squares[2] = (struct piece){PIECE_BLACK, PIECE_BISHOP, false};
-  board.squares[3] = (struct piece){PIECE_BLACK, PIECE_QUEEN, false};
-  board.squares[4] = (struct piece){PIECE_BLACK, PIECE_KING, false};
-  board.squares[5] = (struct piece){PIECE_BLACK, PIECE_BISHOP, false};
-  board.squares[6] = (struct piece){PIECE_BLACK, PIECE_KNIGHT, false};
-  board.squares[7] = (struct piece){PIECE_BLACK, PIECE_ROOK, false};
-  for (int file = 0; file < BOARD_SIZE; ++file)
+// computed once per position and shared by the legal move generation of all pieces
+struct check_info
+{
+  int king_square;
+  // enemy pieces giving check
+  uint64_t checkers;
+  // squares non-king moves must end on to resolve a check
+  uint64_t check_mask;
+  // our pieces that cannot leave the line between our king and an enemy slider
+  uint64_t pinned;
+};
+
+// random keys xored together into `position.key`
+static uint64_t zobrist_pieces[2][PIECE_NONE][BOARD_SIZE * BOARD_SIZE];
+static uint64_t zobrist_side;
+static uint64_t zobrist_castling[16];
+static uint64_t zobrist_en_passant[BOARD_SIZE];
+
+// castling rights kept by a move from or to each square
+static unsigned char castling_masks[BOARD_SIZE * BOARD_SIZE];
+
+void init_tables(void)
+{
+  static bool initialized = false;
+  if (initialized)
   {
-    board.squares[BOARD_SIZE + file] = (struct piece){PIECE_BLACK, PIECE_PAWN, false};
-    board.squares[6 * BOARD_SIZE + file] = (struct piece){PIECE_WHITE, PIECE_PAWN, false};
+    return;
   }
-  for (int rank = 2; rank < 6; ++rank)
+  // xorshift64*, fixed seed so keys are the same in every run
+  uint64_t state = 0x2545f4914f6cdd1d;
+  uint64_t *keys[] = {&zobrist_pieces[0][0][0], &zobrist_side, zobrist_castling, zobrist_en_passant};
+  int counts[] = {sizeof(zobrist_pieces) / sizeof(uint64_t), 1, 16, BOARD_SIZE};
+  for (int i = 0; i < 4; ++i)
   {
-    for (int file = 0; file < BOARD_SIZE; ++file)
+    for (int j = 0; j < counts[i]; ++j)
     {
-      board.squares[rank * BOARD_SIZE + file] = (struct piece){PIECE_WHITE, PIECE_NONE, false};
+      state ^= state >> 12;
+      state ^= state << 25;
+      state ^= state >> 27;
+      keys[i][j] = state * 0x2545f4914f6cdd1d;
     }
   }
-  board.squares[7 * BOARD_SIZE] = (struct piece){PIECE_WHITE, PIECE_ROOK, false};
-  board.squares[7 * BOARD_SIZE + 1] = (struct piece){PIECE_WHITE, PIECE_KNIGHT, false};
-  board.squares[7 * BOARD_SIZE + 2] = (struct piece){PIECE_WHITE, PIECE_BISHOP, false};
-  board.squares[7 * BOARD_SIZE + 3] = (struct piece){PIECE_WHITE, PIECE_QUEEN, false};
-  board.squares[7 * BOARD_SIZE + 4] = (struct piece){PIECE_WHITE, PIECE_KING, false};
-  board.squares[7 * BOARD_SIZE + 5] = (struct piece){PIECE_WHITE, PIECE_BISHOP, false};
-  board.squares[7 * BOARD_SIZE + 6] = (struct piece){PIECE_WHITE, PIECE_KNIGHT, false};
-  board.squares[7 * BOARD_SIZE + 7] = (struct piece){PIECE_WHITE, PIECE_ROOK, false};
-  return board;
+  zobrist_castling[0] = 0;
+  for (int square = 0; square < BOARD_SIZE * BOARD_SIZE; ++square)
+  {
+    castling_masks[square] = CASTLING_ALL;
+  }
+  for (int color = PIECE_WHITE; color <= PIECE_BLACK; ++color)
+  {
+    int rank = color == PIECE_WHITE ? 7 : 0;
+    castling_masks[rank * BOARD_SIZE] &= ~CASTLING_FLAG(CASTLING_LEFT, color);
+    castling_masks[rank * BOARD_SIZE + 7] &= ~CASTLING_FLAG(CASTLING_RIGHT, color);
+    castling_masks[rank * BOARD_SIZE + 4] &= ~CASTLING_FLAG(CASTLING_LEFT | CASTLING_RIGHT, color);
+  }
+  initialized = true;
 }
 
-void board_draw_texture(const struct board *board, SDL_Texture *texture, int rank, int file)
+uint64_t state_key(const struct position *position)
 {
-  SDL_FRect dest;
-  dest.x = board->x + file * board->square_width;
-  dest.y = board->y + rank * board->square_height;
-  dest.w = board->square_width;
-  dest.h = board->square_height;
-  SDL_RenderTexture(board->renderer, texture, NULL, &dest);
+  // everything in the key except the pieces
+  uint64_t key = zobrist_castling[position->castling];
+  if (position->en_passant_possible)
+  {
+    key ^= zobrist_en_passant[position->en_passant_file];
+  }
+  if (position->current_color == PIECE_BLACK)
+  {
+    key ^= zobrist_side;
+  }
+  return key;
 }
 
-void board_draw(const struct board *board, SDL_Texture *textures[12])
+uint64_t board_compute_key(const struct position *position)
 {
-  for (int rank = 0; rank < BOARD_SIZE; ++rank)
+  uint64_t key = state_key(position);
+  for (int color = PIECE_WHITE; color <= PIECE_BLACK; ++color)
   {
-    for (int file = 0; file < BOARD_SIZE; ++file)
+    for (int type = 0; type < PIECE_NONE; ++type)
     {
-      if (((rank + file) & 1) == 0)
-      {
-        SDL_SetRenderDrawColor(board->renderer, 255, 255, 153, 255);
-      }
-      else
-      {
-        SDL_SetRenderDrawColor(board->renderer, 102, 51, 0, 255);
-      }
-      SDL_FRect square;
-      square.x = board->x + file * board->square_width;
-      square.y = board->y + rank * board->square_height;
-      square.w = board->square_width;
-      square.h = board->square_height;
-      SDL_RenderFillRect(board->renderer, &square);
-      struct piece piece = board->squares[rank * BOARD_SIZE + file];
-      if (piece.type != PIECE_NONE)
+      uint64_t pieces = position->pieces[type] & position->colors[color];
+      while (pieces != 0)
       {
-        SDL_Texture *texture = textures[piece.color * 6 + piece.type];
-        board_draw_texture(board, texture, rank, file);
+        key ^= zobrist_pieces[color][type][bitboard_pop_lsb(&pieces)];
       }
     }
   }
+  return key;
 }
 
-bool check_move_pawn(const struct board *board, int from_rank, int from_file, int to_rank, int to_file, bool diagonal, struct piece piece, struct move *moves, int *move_count, enum move_type type)
+void board_set_square(struct position *position, int square, struct piece piece)
 {
-  // other pieces are handled by `check_move`
-  assert(piece.type == PIECE_PAWN);
-  if (to_rank < 0 || to_rank > 7 || to_file < 0 || to_file > 7)
+  struct piece old_piece = position->squares[square];
+  if (old_piece.type != PIECE_NONE)
   {
-    // outside of playing area
-    return false;
-  }
-  struct piece other_piece = board->squares[to_rank * BOARD_SIZE + to_file];
-  if (!diagonal && other_piece.type == PIECE_NONE)
-  {
-    // move straight to an empty square
-    moves[(*move_count)++] = (struct move){to_rank, to_file, type};
-    // we can move through this
-    return true;
+    position->pieces[old_piece.type] &= ~BITBOARD_SQUARE(square);
+    position->colors[old_piece.color] &= ~BITBOARD_SQUARE(square);
+    position->key ^= zobrist_pieces[old_piece.color][old_piece.type][square];
   }
-  if (diagonal && other_piece.type != PIECE_NONE && other_piece.color != piece.color)
+  if (piece.type != PIECE_NONE)
   {
-    // capture another piece diagonally
-    moves[(*move_count)++] = (struct move){to_rank, to_file, MOVE_CAPTURE};
-    return false;
+    position->pieces[piece.type] |= BITBOARD_SQUARE(square);
+    position->colors[piece.color] |= BITBOARD_SQUARE(square);
+    position->key ^= zobrist_pieces[piece.color][piece.type][square];
   }
-  if (diagonal && board->en_passant_possible && to_rank == board->en_passant_rank && to_file == board->en_passant_file)
+  if (piece.type == PIECE_KING)
   {
-    // capture other pawn en passant
-    moves[(*move_count)++] = (struct move){to_rank, to_file, MOVE_EN_PASSANT};
+    position->king_squares[piece.color] = square;
   }
-  return false;
+  position->squares[square] = piece;
 }
 
-bool check_move(const struct board *board, int from_rank, int from_file, int to_rank, int to_file, struct piece piece, struct move *moves, int *move_count)
+struct position board_init(void)
 {
-  // pawns are handled by `check_move_pawn`
-  assert(piece.type != PIECE_PAWN);
-  if (to_rank < 0 || to_rank > 7 || to_file < 0 || to_file > 7)
+  attacks_init();
+  init_tables();
+  struct position position;
+  position.en_passant_possible = false;
+  position.current_color = PIECE_WHITE;
+  position.castling = CASTLING_ALL;
+  position.squares[0] = (struct piece){PIECE_BLACK, PIECE_ROOK};
+  position.squares[1] = (struct piece){PIECE_BLACK, PIECE_KNIGHT};
+  position.squares[2] = (struct piece){PIECE_BLACK, PIECE_BISHOP};
+  position.squares[3] = (struct piece){PIECE_BLACK, PIECE_QUEEN};
+  position.squares[4] = (struct piece){PIECE_BLACK, PIECE_KING};
+  position.squares[5] = (struct piece){PIECE_BLACK, PIECE_BISHOP};
+  position.squares[6] = (struct piece){PIECE_BLACK, PIECE_KNIGHT};
+  position.squares[7] = (struct piece){PIECE_BLACK, PIECE_ROOK};
+  for (int file = 0; file < BOARD_SIZE; ++file)
   {
-    // outside of playing area
-    return false;
+    position.squares[BOARD_SIZE + file] = (struct piece){PIECE_BLACK, PIECE_PAWN};
+    position.squares[6 * BOARD_SIZE + file] = (struct piece){PIECE_WHITE, PIECE_PAWN};
   }
-  struct piece other_piece = board->squares[to_rank * BOARD_SIZE + to_file];
-  if (other_piece.type == PIECE_NONE)
+  for (int rank = 2; rank < 6; ++rank)
   {
-    // move to an empty square
-    moves[(*move_count)++] = (struct move){to_rank, to_file, MOVE_NORMAL};
-    // we can move through this square
-    return true;
+    for (int file = 0; file < BOARD_SIZE; ++file)
+    {
+      position.squares[rank * BOARD_SIZE + file] = (struct piece){PIECE_WHITE, PIECE_NONE};
+    }
   }
-  if (other_piece.color != piece.color)
+  position.squares[7 * BOARD_SIZE] = (struct piece){PIECE_WHITE, PIECE_ROOK};
+  position.squares[7 * BOARD_SIZE + 1] = (struct piece){PIECE_WHITE, PIECE_KNIGHT};
+  position.squares[7 * BOARD_SIZE + 2] = (struct piece){PIECE_WHITE, PIECE_BISHOP};
+  position.squares[7 * BOARD_SIZE + 3] = (struct piece){PIECE_WHITE, PIECE_QUEEN};
+  position.squares[7 * BOARD_SIZE + 4] = (struct piece){PIECE_WHITE, PIECE_KING};
+  position.squares[7 * BOARD_SIZE + 5] = (struct piece){PIECE_WHITE, PIECE_BISHOP};
+  position.squares[7 * BOARD_SIZE + 6] = (struct piece){PIECE_WHITE, PIECE_KNIGHT};
+  position.squares[7 * BOARD_SIZE + 7] = (struct piece){PIECE_WHITE, PIECE_ROOK};
+  memset(position.pieces, 0, sizeof(position.pieces));
+  memset(position.colors, 0, sizeof(position.colors));
+  for (int square = 0; square < BOARD_SIZE * BOARD_SIZE; ++square)
   {
-    // capture another piece
-    moves[(*move_count)++] = (struct move){to_rank, to_file, MOVE_CAPTURE};
-    // we cannot move through this square
-    return false;
+    struct piece piece = position.squares[square];
+    if (piece.type != PIECE_NONE)
+    {
+      position.pieces[piece.type] |= BITBOARD_SQUARE(square);
+      position.colors[piece.color] |= BITBOARD_SQUARE(square);
+    }
   }
-  return false;
+  position.king_squares[PIECE_WHITE] = 7 * BOARD_SIZE + 4;
+  position.king_squares[PIECE_BLACK] = 4;
+  position.halfmove_clock = 0;
+  position.key = board_compute_key(&position);
+  return position;
 }
 
-void get_straight_moves(const struct board *board, int rank, int file, struct piece piece, struct move moves[32], int *move_count)
+bool en_passant_capturable(const struct position *position, int square, enum piece_color color)
 {
-  // move up
-  for (int i = 1; i <= rank; ++i)
+  // a pawn of `color` stands where a pawn of the other color on `square` would attack
+  enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  return (attacks_pawn(other_color, square) & position->pieces[PIECE_PAWN] & position->colors[color]) != 0;
+}
+
+bool board_from_fen(struct position *position, const char *fen)
+{
+  // same order as `enum piece_type`
+  static const char piece_chars[] = "bknpqr";
+  struct position result = board_init();
+  for (int square = 0; square < BOARD_SIZE * BOARD_SIZE; ++square)
   {
-    if (!check_move(board, rank, file, rank - i, file, piece, moves, move_count))
-    {
-      break;
-    }
+    board_set_square(&result, square, (struct piece){PIECE_WHITE, PIECE_NONE});
   }
-  // move right
-  for (int i = 1; i < BOARD_SIZE - file; ++i)
+  // ranks are listed starting at black's side, which is rank 0 here as well
+  int rank = 0;
+  int file = 0;
+  for (; *fen != ' '; ++fen)
   {
-    if (!check_move(board, rank, file, rank, file + i, piece, moves, move_count))
+    if (*fen == '\0')
+    {
+      return false;
+    }
+    if (*fen == '/')
+    {
+      // every rank has to account for all of its squares
+      if (file != BOARD_SIZE || ++rank >= BOARD_SIZE)
+      {
+        return false;
+      }
+      file = 0;
+      continue;
+    }
+    if (*fen >= '1' && *fen <= '8')
+    {
+      file += *fen - '0';
+      if (file > BOARD_SIZE)
+      {
+        return false;
+      }
+      continue;
+    }
+    const char *type = strchr(piece_chars, tolower((unsigned char)*fen));
+    if (type == NULL || file >= BOARD_SIZE)
     {
-      break;
+      return false;
     }
+    board_set_square(&result, rank * BOARD_SIZE + file++, (struct piece){isupper((unsigned char)*fen) ? PIECE_WHITE : PIECE_BLACK, type - piece_chars});
   }
-  // move down
-  for (int i = 1; i < BOARD_SIZE - rank; ++i)
+  if (rank != BOARD_SIZE - 1 || file != BOARD_SIZE)
   {
-    if (!check_move(board, rank, file, rank + i, file, piece, moves, move_count))
+    return false;
+  }
+  for (int color = PIECE_WHITE; color <= PIECE_BLACK; ++color)
+  {
+    if (bitboard_count(result.pieces[PIECE_KING] & result.colors[color]) != 1)
     {
-      break;
+      return false;
     }
   }
-  // move left
-  for (int i = 1; i <= file; ++i)
+  if (result.pieces[PIECE_PAWN] & (BITBOARD_RANK(0) | BITBOARD_RANK(BOARD_SIZE - 1)))
+  {
+    // pawns never stand on either back rank
+    return false;
+  }
+  ++fen;
+  if ((*fen != 'w' && *fen != 'b') || fen[1] != ' ')
   {
-    if (!check_move(board, rank, file, rank, file - i, piece, moves, move_count))
+    return false;
+  }
+  result.current_color = *fen == 'w' ? PIECE_WHITE : PIECE_BLACK;
+  fen += 2;
+  result.castling = 0;
+  for (; *fen != ' ' && *fen != '\0'; ++fen)
+  {
+    if (*fen == 'K')
+    {
+      result.castling |= CASTLING_FLAG(CASTLING_RIGHT, PIECE_WHITE);
+    }
+    else if (*fen == 'Q')
+    {
+      result.castling |= CASTLING_FLAG(CASTLING_LEFT, PIECE_WHITE);
+    }
+    else if (*fen == 'k')
+    {
+      result.castling |= CASTLING_FLAG(CASTLING_RIGHT, PIECE_BLACK);
+    }
+    else if (*fen == 'q')
     {
-      break;
+      result.castling |= CASTLING_FLAG(CASTLING_LEFT, PIECE_BLACK);
+    }
+    else if (*fen != '-')
+    {
+      return false;
     }
   }
-}
-
-void get_diagonal_moves(const struct board *board, int rank, int file, struct piece piece, struct move moves[32], int *move_count)
-{
-  // move up-left
-  for (int i = 1; i <= rank; ++i)
+  for (int color = PIECE_WHITE; color <= PIECE_BLACK; ++color)
   {
-    if (!check_move(board, rank, file, rank - i, file - i, piece, moves, move_count))
+    // castling rights need the king and the matching rook on their home squares
+    int home = color == PIECE_WHITE ? (BOARD_SIZE - 1) * BOARD_SIZE : 0;
+    uint64_t rooks = result.pieces[PIECE_ROOK] & result.colors[color];
+    bool king_home = result.king_squares[color] == home + 4;
+    if ((result.castling & CASTLING_FLAG(CASTLING_LEFT, color)) && (!king_home || (rooks & BITBOARD_SQUARE(home)) == 0))
+    {
+      return false;
+    }
+    if ((result.castling & CASTLING_FLAG(CASTLING_RIGHT, color)) && (!king_home || (rooks & BITBOARD_SQUARE(home + 7)) == 0))
     {
-      break;
+      return false;
     }
   }
-  // move up-right
-  for (int i = 1; i <= rank; ++i)
+  if (*fen == ' ')
+  {
+    ++fen;
+  }
+  result.en_passant_possible = false;
+  if (*fen == '-')
   {
-    if (!check_move(board, rank, file, rank - i, file + i, piece, moves, move_count))
+    ++fen;
+  }
+  else if (*fen != '\0')
+  {
+    if (*fen < 'a' || *fen > 'h' || (fen[1] != '3' && fen[1] != '6'))
+    {
+      return false;
+    }
+    // the square the other side's pawn just skipped, with that pawn right in front of it
+    result.en_passant_rank = '8' - fen[1];
+    result.en_passant_file = *fen - 'a';
+    int en_passant_square = result.en_passant_rank * BOARD_SIZE + result.en_passant_file;
+    int pushed = en_passant_square + (result.current_color == PIECE_WHITE ? BOARD_SIZE : -BOARD_SIZE);
+    if (result.en_passant_rank != (result.current_color == PIECE_WHITE ? 2 : BOARD_SIZE - 3) || result.squares[en_passant_square].type != PIECE_NONE
+      || result.squares[pushed].type != PIECE_PAWN || result.squares[pushed].color == result.current_color)
     {
-      break;
+      return false;
     }
+    // kept, and hashed, only when it can be taken, like `board_make_move` does
+    result.en_passant_possible = en_passant_capturable(&result, en_passant_square, result.current_color);
+    fen += 2;
   }
-  // move down-left
-  for (int i = 1; i < BOARD_SIZE - rank; ++i)
+  if (*fen != ' ' && *fen != '\0')
   {
-    if (!check_move(board, rank, file, rank + i, file - i, piece, moves, move_count))
+    return false;
+  }
+  // the move counters are optional, the fullmove number is not kept
+  result.halfmove_clock = 0;
+  if (*fen == ' ')
+  {
+    char *end;
+    long clock = strtol(fen + 1, &end, 10);
+    if (end == fen + 1 || clock < 0 || (*end != ' ' && *end != '\0'))
     {
-      break;
+      return false;
     }
+    result.halfmove_clock = (int)clock;
   }
-  // move down-right
-  for (int i = 1; i < BOARD_SIZE - rank; ++i)
+  result.key = board_compute_key(&result);
+  *position = result;
+  return true;
+}
+
+void add_pawn_move(int from, int to, enum move_type type, struct move moves[32], int *move_count)
+{
+  int rank = to / BOARD_SIZE;
+  if (rank != 0 && rank != BOARD_SIZE - 1)
   {
-    if (!check_move(board, rank, file, rank + i, file + i, piece, moves, move_count))
+    moves[(*move_count)++] = move_make(from, to, type);
+    return;
+  }
+  // a pawn reaching the last rank has to promote
+  enum move_type first = type == MOVE_CAPTURE ? MOVE_CAPTURE_PROMOTE_KNIGHT : MOVE_PROMOTE_KNIGHT;
+  for (int i = 0; i < 4; ++i)
+  {
+    moves[(*move_count)++] = move_make(from, to, first + i);
+  }
+}
+
+void add_moves(const struct position *position, int from, uint64_t targets, struct move moves[32], int *move_count)
+{
+  struct piece piece = position->squares[from];
+  // pawns are handled by `add_pawn_moves`
+  assert(piece.type != PIECE_PAWN);
+  enum piece_color other_color = piece.color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  // we cannot move onto our own pieces
+  targets &= ~position->colors[piece.color];
+  while (targets != 0)
+  {
+    int square = bitboard_pop_lsb(&targets);
+    enum move_type type = position->colors[other_color] & BITBOARD_SQUARE(square) ? MOVE_CAPTURE : MOVE_NORMAL;
+    moves[(*move_count)++] = move_make(from, square, type);
+  }
+}
+
+// the helpers from here to `add_king_moves` are shared by the per-square functions
+// and the two instances of `generate`, they are always inlined so that `color` is
+// a constant in the latter and the tests on it fold away
+
+static inline __attribute__((always_inline)) uint64_t attackers_to(const struct position *position, int square, uint64_t occupied)
+{
+  // a white pawn attacks `square` if a black pawn on `square` would attack it, and the other way around
+  uint64_t pawns = (attacks_pawn(PIECE_BLACK, square) & position->colors[PIECE_WHITE]) | (attacks_pawn(PIECE_WHITE, square) & position->colors[PIECE_BLACK]);
+  uint64_t rooks = position->pieces[PIECE_ROOK] | position->pieces[PIECE_QUEEN];
+  uint64_t bishops = position->pieces[PIECE_BISHOP] | position->pieces[PIECE_QUEEN];
+  return (pawns & position->pieces[PIECE_PAWN])
+    | (attacks_knight(square) & position->pieces[PIECE_KNIGHT])
+    | (attacks_king(square) & position->pieces[PIECE_KING])
+    | (attacks_rook(square, occupied) & rooks)
+    | (attacks_bishop(square, occupied) & bishops);
+}
+
+static inline __attribute__((always_inline)) uint64_t pawn_push(uint64_t pawns, enum piece_color color)
+{
+  // white pawns move towards rank 0, black pawns towards rank 7
+  return color == PIECE_WHITE ? pawns >> BOARD_SIZE : pawns << BOARD_SIZE;
+}
+
+static inline __attribute__((always_inline)) uint64_t pawn_double_push(uint64_t single, enum piece_color color, uint64_t empty)
+{
+  // pawns that just left their starting rank may move once more
+  return pawn_push(single & BITBOARD_RANK(color == PIECE_WHITE ? 5 : 2), color) & empty;
+}
+
+static inline __attribute__((always_inline)) uint64_t pawn_captures_left(uint64_t pawns, enum piece_color color)
+{
+  // towards file 0, pawns on the edge would wrap around
+  return pawn_push(pawns & ~BITBOARD_FILE(0), color) >> 1;
+}
+
+static inline __attribute__((always_inline)) uint64_t pawn_captures_right(uint64_t pawns, enum piece_color color)
+{
+  // towards file 7, pawns on the edge would wrap around
+  return pawn_push(pawns & ~BITBOARD_FILE(BOARD_SIZE - 1), color) << 1;
+}
+
+static inline __attribute__((always_inline)) void add_pawn_targets(const struct check_info *info, uint64_t targets, int offset, enum move_type type, struct move moves[], int *move_count)
+{
+  // `offset` leads from each target back to the pawn moving there
+  while (targets != 0)
+  {
+    int to = bitboard_pop_lsb(&targets);
+    int from = to + offset;
+    if ((info->pinned & BITBOARD_SQUARE(from)) && (attacks_line(info->king_square, from) & BITBOARD_SQUARE(to)) == 0)
     {
-      break;
+      continue;
     }
+    add_pawn_move(from, to, type, moves, move_count);
   }
 }
 
-void check_castle_left(const struct board *board, int rank, struct move moves[32], int *move_count)
+static inline __attribute__((always_inline)) void add_pawn_moves(const struct position *position, const struct check_info *info, uint64_t pawns, enum piece_color color, enum move_kind kind, struct move moves[], int *move_count)
 {
-  enum piece_color color = board->squares[rank * 8 + 4].color;
-  if (board->squares[rank * 8].has_moved)
+  // everything but en passant, see `add_en_passant`
+  enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  uint64_t empty = ~(position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK]);
+  int forward = color == PIECE_WHITE ? -BOARD_SIZE : BOARD_SIZE;
+  if (kind != MOVES_CAPTURES)
   {
-    // cannot castle when rook has moved
-    return;
+    uint64_t single = pawn_push(pawns, color) & empty;
+    add_pawn_targets(info, single & info->check_mask, -forward, MOVE_NORMAL, moves, move_count);
+    add_pawn_targets(info, pawn_double_push(single, color, empty) & info->check_mask, -2 * forward, MOVE_DOUBLE, moves, move_count);
   }
-  if (board->squares[rank * 8 + 1].type != PIECE_NONE || board->squares[rank * 8 + 2].type != PIECE_NONE || board->squares[rank * 8 + 3].type != PIECE_NONE)
+  if (kind == MOVES_QUIETS)
   {
-    // cannot castle when squares are occupied
     return;
   }
-  struct board new_board;
-  memcpy(&new_board, board, sizeof(struct board));
-  board_make_move(&new_board, rank, 4, &(struct move){rank, 3, MOVE_NORMAL});
-  if (board_in_check(&new_board, color))
+  uint64_t enemies = position->colors[other_color] & info->check_mask;
+  add_pawn_targets(info, pawn_captures_left(pawns, color) & enemies, 1 - forward, MOVE_CAPTURE, moves, move_count);
+  add_pawn_targets(info, pawn_captures_right(pawns, color) & enemies, -1 - forward, MOVE_CAPTURE, moves, move_count);
+}
+
+static inline __attribute__((always_inline)) void add_en_passant(const struct position *position, uint64_t pawns, enum piece_color color, struct move moves[], int *move_count)
+{
+  if (!position->en_passant_possible)
   {
-    // cannot castle if intermediate position would be in check
     return;
   }
-  moves[(*move_count)++] = (struct move){rank, 2, MOVE_CASTLE_LEFT};
+  enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  int to = position->en_passant_rank * BOARD_SIZE + position->en_passant_file;
+  uint64_t from_squares = attacks_pawn(other_color, to) & pawns;
+  while (from_squares != 0)
+  {
+    moves[(*move_count)++] = move_make(bitboard_pop_lsb(&from_squares), to, MOVE_EN_PASSANT);
+  }
 }
 
-void check_castle_right(const struct board *board, int rank, struct move moves[32], int *move_count)
+static inline __attribute__((always_inline)) void add_legal_en_passant(struct position *position, uint64_t pawns, enum piece_color color, struct move moves[], int *move_count)
 {
-  enum piece_color color = board->squares[rank * 8 + 4].color;
-  if (board->squares[rank * 8 + 7].has_moved)
+  struct move candidates[2];
+  int candidate_count = 0;
+  add_en_passant(position, pawns, color, candidates, &candidate_count);
+  for (int i = 0; i < candidate_count; ++i)
   {
-    // cannot castle when rook has moved
-    return;
+    // removes two pieces from the same rank at once, so just try it
+    struct undo undo;
+    board_make_move(position, candidates[i], &undo);
+    bool in_check = board_in_check(position, color);
+    board_unmake_move(position, &undo);
+    if (!in_check)
+    {
+      moves[(*move_count)++] = candidates[i];
+    }
   }
-  if (board->squares[rank * 8 + 5].type != PIECE_NONE || board->squares[rank * 8 + 6].type != PIECE_NONE)
+}
+
+static inline __attribute__((always_inline)) void add_castling_moves(const struct position *position, enum piece_color color, struct move moves[], int *move_count)
+{
+  // the caller has made sure the king is not in check
+  enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  int rank = color == PIECE_WHITE ? BOARD_SIZE - 1 : 0;
+  uint64_t occupied = position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK];
+  // the squares between king and rook must be empty, the king must not pass or land on an attacked one
+  uint64_t left_path = BITBOARD_SQUARE(rank * 8 + 1) | BITBOARD_SQUARE(rank * 8 + 2) | BITBOARD_SQUARE(rank * 8 + 3);
+  if ((position->castling & CASTLING_FLAG(CASTLING_LEFT, color)) != 0 && (occupied & left_path) == 0
+    && !board_is_square_attacked(position, rank * 8 + 3, other_color) && !board_is_square_attacked(position, rank * 8 + 2, other_color))
   {
-    // cannot castle when squares are occupied
-    return;
+    moves[(*move_count)++] = move_make(rank * 8 + 4, rank * 8 + 2, MOVE_CASTLE_LEFT);
   }
-  struct board new_board;
-  memcpy(&new_board, board, sizeof(struct board));
-  board_make_move(&new_board, rank, 4, &(struct move){rank, 5, MOVE_NORMAL});
-  if (board_in_check(&new_board, color))
+  uint64_t right_path = BITBOARD_SQUARE(rank * 8 + 5) | BITBOARD_SQUARE(rank * 8 + 6);
+  if ((position->castling & CASTLING_FLAG(CASTLING_RIGHT, color)) != 0 && (occupied & right_path) == 0
+    && !board_is_square_attacked(position, rank * 8 + 5, other_color) && !board_is_square_attacked(position, rank * 8 + 6, other_color))
   {
-    // cannot castle if intermediate position would be in check
-    return;
+    moves[(*move_count)++] = move_make(rank * 8 + 4, rank * 8 + 6, MOVE_CASTLE_RIGHT);
   }
-  moves[(*move_count)++] = (struct move){rank, 6, MOVE_CASTLE_RIGHT};
 }
 
-int board_get_pseudo_moves(const struct board *board, int rank, int file, struct move moves[32], bool castling)
+static inline __attribute__((always_inline)) void add_king_moves(const struct position *position, const struct check_info *info, enum piece_color color, enum move_kind kind, struct move moves[], int *move_count)
 {
-  struct piece piece = board->squares[rank * BOARD_SIZE + file];
-  assert(piece.type != PIECE_NONE);
-  int move_count = 0;
-  if (piece.type == PIECE_BISHOP)
+  enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  uint64_t occupied = position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK];
+  uint64_t targets = attacks_king(info->king_square) & ~position->colors[color];
+  if (kind == MOVES_CAPTURES)
   {
-    get_diagonal_moves(board, rank, file, piece, moves, &move_count);
+    targets &= position->colors[other_color];
   }
-  else if (piece.type == PIECE_KING)
+  else if (kind == MOVES_QUIETS)
   {
-    // normal movement
-    for (int i = -1; i <= 1; ++i)
+    targets &= ~occupied;
+  }
+  // the king itself must not block attacks along the line it moves on
+  uint64_t without_king = occupied & ~BITBOARD_SQUARE(info->king_square);
+  while (targets != 0)
+  {
+    int to = bitboard_pop_lsb(&targets);
+    if ((attackers_to(position, to, without_king) & position->colors[other_color]) == 0)
     {
-      for (int j = -1; j <= 1; ++j)
-      {
-        check_move(board, rank, file, rank + i, file + j, piece, moves, &move_count);
-      }
+      enum move_type type = position->colors[other_color] & BITBOARD_SQUARE(to) ? MOVE_CAPTURE : MOVE_NORMAL;
+      moves[(*move_count)++] = move_make(info->king_square, to, type);
     }
-    if (castling)
+  }
+  if (kind != MOVES_CAPTURES && info->checkers == 0)
+  {
+    add_castling_moves(position, color, moves, move_count);
+  }
+}
+
+uint64_t bishop_targets(int square, uint64_t occupied)
+{
+  return attacks_bishop(square, occupied);
+}
+
+uint64_t king_targets(int square, uint64_t occupied)
+{
+  (void)occupied;
+  // castling is checked separately
+  return attacks_king(square);
+}
+
+uint64_t knight_targets(int square, uint64_t occupied)
+{
+  (void)occupied;
+  return attacks_knight(square);
+}
+
+uint64_t queen_targets(int square, uint64_t occupied)
+{
+  return attacks_queen(square, occupied);
+}
+
+uint64_t rook_targets(int square, uint64_t occupied)
+{
+  return attacks_rook(square, occupied);
+}
+
+// where each piece but the pawn can go, indexed by type
+static uint64_t (*const piece_targets[PIECE_NONE])(int square, uint64_t occupied) = {
+  [PIECE_BISHOP] = bishop_targets,
+  [PIECE_KING] = king_targets,
+  [PIECE_KNIGHT] = knight_targets,
+  [PIECE_QUEEN] = queen_targets,
+  [PIECE_ROOK] = rook_targets,
+};
+
+// the types the generators walk one after the other, pawns and the king are
+// handled on their own, the most common pieces come first
+static const enum piece_type piece_order[] = {PIECE_KNIGHT, PIECE_BISHOP, PIECE_ROOK, PIECE_QUEEN};
+
+#define PIECE_ORDER_COUNT (int)(sizeof(piece_order) / sizeof(piece_order[0]))
+
+int get_piece_moves(const struct position *position, int square, struct piece piece, struct move moves[32], enum move_kind kind)
+{
+  assert(piece.type != PIECE_NONE);
+  if (piece.type == PIECE_PAWN)
+  {
+    // no check to answer and no pins to keep
+    static const struct check_info unrestricted = {0, 0, ~(uint64_t)0, 0};
+    int move_count = 0;
+    add_pawn_moves(position, &unrestricted, BITBOARD_SQUARE(square), piece.color, kind, moves, &move_count);
+    if (kind != MOVES_QUIETS)
     {
-      if (piece.has_moved || board_in_check(board, piece.color))
-      {
-        // no castling possible when king has moved or is in check
-        return move_count;
-      }
-      check_castle_left(board, rank, moves, &move_count);
-      check_castle_right(board, rank, moves, &move_count);
+      add_en_passant(position, BITBOARD_SQUARE(square), piece.color, moves, &move_count);
     }
+    return move_count;
+  }
+  uint64_t occupied = position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK];
+  // squares the moves of `kind` may end on, `add_moves` removes our own pieces
+  uint64_t targets = ~(uint64_t)0;
+  if (kind == MOVES_CAPTURES)
+  {
+    targets = occupied;
+  }
+  else if (kind == MOVES_QUIETS)
+  {
+    targets = ~occupied;
+  }
+  int move_count = 0;
+  add_moves(position, square, piece_targets[piece.type](square, occupied) & targets, moves, &move_count);
+  return move_count;
+}
+
+int board_get_pseudo_moves(const struct position *position, int rank, int file, struct move moves[32], bool castling)
+{
+  struct piece piece = position->squares[rank * BOARD_SIZE + file];
+  int move_count = get_piece_moves(position, rank * BOARD_SIZE + file, piece, moves, MOVES_ALL);
+  if (!castling || piece.type != PIECE_KING)
+  {
+    return move_count;
+  }
+  if ((position->castling & CASTLING_FLAG(CASTLING_LEFT | CASTLING_RIGHT, piece.color)) == 0 || board_in_check(position, piece.color))
+  {
+    // no castling possible when king has moved or is in check
+    return move_count;
+  }
+  add_castling_moves(position, piece.color, moves, &move_count);
+  return move_count;
+}
+
+uint64_t piece_attacks(int square, struct piece piece, uint64_t occupied)
+{
+  // pawns capture differently from how they move, everything else attacks where it can go
+  if (piece.type == PIECE_PAWN)
+  {
+    return attacks_pawn(piece.color, square);
   }
-  else if (piece.type == PIECE_KNIGHT)
+  return piece.type == PIECE_NONE ? 0 : piece_targets[piece.type](square, occupied);
+}
+
+uint64_t move_changed_squares(struct move move, enum piece_color color)
+{
+  int from = move_get_from(move);
+  int to = move_get_to(move);
+  int rank = from / BOARD_SIZE;
+  uint64_t changed = BITBOARD_SQUARE(from) | BITBOARD_SQUARE(to);
+  switch (move_get_type(move))
   {
-    for (int rank_distance = -2; rank_distance <= 2; ++rank_distance)
+  case MOVE_EN_PASSANT:
+    return changed | BITBOARD_SQUARE(to + (color == PIECE_WHITE ? BOARD_SIZE : -BOARD_SIZE));
+  case MOVE_CASTLE_LEFT:
+    return changed | BITBOARD_SQUARE(rank * 8) | BITBOARD_SQUARE(rank * 8 + 3);
+  case MOVE_CASTLE_RIGHT:
+    return changed | BITBOARD_SQUARE(rank * 8 + 7) | BITBOARD_SQUARE(rank * 8 + 5);
+  default:
+    return changed;
+  }
+}
+
+uint64_t attack_map_affected(const struct position *position, uint64_t changed)
+{
+  // only the pieces standing on changed squares and the sliders looking at
+  // one of them can attack something different after the change
+  uint64_t occupied = position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK];
+  uint64_t rooks = position->pieces[PIECE_ROOK] | position->pieces[PIECE_QUEEN];
+  uint64_t bishops = position->pieces[PIECE_BISHOP] | position->pieces[PIECE_QUEEN];
+  uint64_t affected = changed & occupied;
+  while (changed != 0)
+  {
+    int square = bitboard_pop_lsb(&changed);
+    affected |= (attacks_rook(square, occupied) & rooks) | (attacks_bishop(square, occupied) & bishops);
+  }
+  return affected;
+}
+
+void attack_map_update(const struct position *position, struct attack_map *map, uint64_t pieces, int delta)
+{
+  uint64_t occupied = position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK];
+  while (pieces != 0)
+  {
+    int square = bitboard_pop_lsb(&pieces);
+    struct piece piece = position->squares[square];
+    uint64_t attacks = piece_attacks(square, piece, occupied);
+    while (attacks != 0)
     {
-      if (rank_distance == 0)
+      int target = bitboard_pop_lsb(&attacks);
+      map->counts[piece.color][target] += delta;
+      if (map->counts[piece.color][target] != 0)
+      {
+        map->attacked[piece.color] |= BITBOARD_SQUARE(target);
+      }
+      else
       {
-        // a knight always moves at least one rank
-        continue;
+        map->attacked[piece.color] &= ~BITBOARD_SQUARE(target);
       }
-      // if we move 2 ranks, we move 1 file,
-      // if we move 1 rank, we move 2 files
-      int file_distance = 3 - abs(rank_distance);
-      int left_file = file - file_distance;
-      int right_file = file + file_distance;
-      int new_rank = rank + rank_distance;
-      check_move(board, rank, file, new_rank, left_file, piece, moves, &move_count);
-      check_move(board, rank, file, new_rank, right_file, piece, moves, &move_count);
     }
   }
-  else if (piece.type == PIECE_PAWN)
+}
+
+void board_attack_map_init(struct attack_map *map, const struct position *position)
+{
+  memset(map, 0, sizeof(struct attack_map));
+  attack_map_update(position, map, position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK], 1);
+}
+
+// both entry points below inline this, so the map tests fold away for `board_make_move`
+static inline __attribute__((always_inline)) void make_move(struct position *position, struct attack_map *map, struct move move, struct undo *undo)
+{
+  int from = move_get_from(move);
+  int to = move_get_to(move);
+  enum move_type type = move_get_type(move);
+  int rank = from / BOARD_SIZE;
+  struct piece moved = position->squares[from];
+  int direction = moved.color == PIECE_WHITE ? -1 : 1;
+  undo->move = move;
+  undo->captured = position->squares[to];
+  undo->en_passant_possible = position->en_passant_possible;
+  undo->en_passant_rank = position->en_passant_rank;
+  undo->en_passant_file = position->en_passant_file;
+  undo->castling = position->castling;
+  undo->halfmove_clock = position->halfmove_clock;
+  undo->key = position->key;
+  uint64_t changed = 0;
+  if (map != NULL)
   {
-    int direction = piece.color == PIECE_WHITE ? -1 : 1;
-    bool success = check_move_pawn(board, rank, file, rank + direction, file, false, piece, moves, &move_count, MOVE_NORMAL);
-    if (success && (rank == 1 && piece.color == PIECE_BLACK || rank == 6 && piece.color == PIECE_WHITE))
-    {
-      // pawn is in starting position, allow double move
-      check_move_pawn(board, rank, file, rank + 2 * direction, file, false, piece, moves, &move_count, MOVE_DOUBLE);
-    }
-    check_move_pawn(board, rank, file, rank + direction, file - 1, true, piece, moves, &move_count, MOVE_NORMAL);
-    check_move_pawn(board, rank, file, rank + direction, file + 1, true, piece, moves, &move_count, MOVE_NORMAL);
+    changed = move_changed_squares(move, moved.color);
+    attack_map_update(position, map, attack_map_affected(position, changed), -1);
   }
-  else if (piece.type == PIECE_QUEEN)
+  // take out the old castling rights, en passant file and side to move, put the new ones back in at the end
+  position->key ^= state_key(position);
+  if (type == MOVE_DOUBLE)
   {
-    get_straight_moves(board, rank, file, piece, moves, &move_count);
-    get_diagonal_moves(board, rank, file, piece, moves, &move_count);
+    // double pawn push, only an en passant square an enemy pawn can take goes
+    // into the key, otherwise the same position would hash differently later
+    position->en_passant_rank = to / BOARD_SIZE - direction;
+    position->en_passant_file = to % BOARD_SIZE;
+    position->en_passant_possible = en_passant_capturable(position, to - direction * BOARD_SIZE, moved.color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE);
   }
-  else if (piece.type == PIECE_ROOK)
+  else
   {
-    get_straight_moves(board, rank, file, piece, moves, &move_count);
+    position->en_passant_possible = false;
   }
-  return move_count;
+  if (moved.type == PIECE_PAWN || move_is_capture(move))
+  {
+    // cannot go back to anything before this, restart the fifty move count
+    position->halfmove_clock = 0;
+  }
+  else
+  {
+    ++position->halfmove_clock;
+  }
+  if (move_is_promotion(move))
+  {
+    moved.type = move_get_promotion(move);
+  }
+  // moving from or onto a king or rook home square loses the matching rights
+  position->castling &= castling_masks[from] & castling_masks[to];
+  board_set_square(position, from, (struct piece){PIECE_WHITE, PIECE_NONE});
+  board_set_square(position, to, moved);
+  if (type == MOVE_EN_PASSANT)
+  {
+    undo->captured = position->squares[to - direction * BOARD_SIZE];
+    board_set_square(position, to - direction * BOARD_SIZE, (struct piece){PIECE_WHITE, PIECE_NONE});
+  }
+  if (type == MOVE_CASTLE_LEFT)
+  {
+    struct piece rook = position->squares[rank * 8];
+    board_set_square(position, rank * 8, (struct piece){PIECE_WHITE, PIECE_NONE});
+    board_set_square(position, rank * 8 + 3, rook);
+  }
+  if (type == MOVE_CASTLE_RIGHT)
+  {
+    struct piece rook = position->squares[rank * 8 + 7];
+    board_set_square(position, rank * 8 + 7, (struct piece){PIECE_WHITE, PIECE_NONE});
+    board_set_square(position, rank * 8 + 5, rook);
+  }
+  position->current_color = position->current_color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  position->key ^= state_key(position);
+  if (map != NULL)
+  {
+    attack_map_update(position, map, attack_map_affected(position, changed), 1);
+  }
+}
+
+void board_make_move(struct position *position, struct move move, struct undo *undo)
+{
+  make_move(position, NULL, move, undo);
+}
+
+void board_make_move_mapped(struct position *position, struct attack_map *map, struct move move, struct undo *undo)
+{
+  make_move(position, map, move, undo);
 }
 
-void board_make_move(struct board *board, int from_rank, int from_file, const struct move *move)
+static inline __attribute__((always_inline)) void unmake_move(struct position *position, struct attack_map *map, const struct undo *undo)
 {
-  struct piece moved = board->squares[from_rank * 8 + from_file];
-  moved.has_moved = true;
+  int from = move_get_from(undo->move);
+  int to = move_get_to(undo->move);
+  enum move_type type = move_get_type(undo->move);
+  int rank = from / BOARD_SIZE;
+  struct piece moved = position->squares[to];
   int direction = moved.color == PIECE_WHITE ? -1 : 1;
-  if (move->type == MOVE_DOUBLE)
+  uint64_t changed = 0;
+  if (map != NULL)
   {
-    // double pawn push
-    board->en_passant_possible = true;
-    board->en_passant_rank = move->rank - direction;
-    board->en_passant_file = move->file;
+    changed = move_changed_squares(undo->move, moved.color);
+    attack_map_update(position, map, attack_map_affected(position, changed), -1);
+  }
+  if (move_is_promotion(undo->move))
+  {
+    moved.type = PIECE_PAWN;
+  }
+  board_set_square(position, from, moved);
+  if (type == MOVE_EN_PASSANT)
+  {
+    // the captured pawn was behind the target square
+    board_set_square(position, to, (struct piece){PIECE_WHITE, PIECE_NONE});
+    board_set_square(position, to - direction * BOARD_SIZE, undo->captured);
   }
   else
   {
-    board->en_passant_possible = false;
+    board_set_square(position, to, undo->captured);
   }
-  board->squares[from_rank * 8 + from_file] = (struct piece){PIECE_WHITE, PIECE_NONE, false};
-  board->squares[move->rank * 8 + move->file] = moved;
-  if (move->type == MOVE_EN_PASSANT)
+  if (type == MOVE_CASTLE_LEFT)
   {
-    board->squares[(move->rank - direction) * 8 + move->file] = (struct piece){PIECE_WHITE, PIECE_NONE, false};
+    struct piece rook = position->squares[rank * 8 + 3];
+    board_set_square(position, rank * 8 + 3, (struct piece){PIECE_WHITE, PIECE_NONE});
+    board_set_square(position, rank * 8, rook);
   }
-  if (move->type == MOVE_CASTLE_LEFT)
+  if (type == MOVE_CASTLE_RIGHT)
   {
-    struct piece rook = board->squares[from_rank * 8];
-    rook.has_moved = true;
-    board->squares[from_rank * 8] = (struct piece){PIECE_WHITE, PIECE_NONE, false};
-    board->squares[from_rank * 8 + 3] = rook;
+    struct piece rook = position->squares[rank * 8 + 5];
+    board_set_square(position, rank * 8 + 5, (struct piece){PIECE_WHITE, PIECE_NONE});
+    board_set_square(position, rank * 8 + 7, rook);
   }
-  if (move->type == MOVE_CASTLE_RIGHT)
+  position->en_passant_possible = undo->en_passant_possible;
+  position->en_passant_rank = undo->en_passant_rank;
+  position->en_passant_file = undo->en_passant_file;
+  position->castling = undo->castling;
+  position->halfmove_clock = undo->halfmove_clock;
+  position->current_color = moved.color;
+  position->key = undo->key;
+  if (map != NULL)
   {
-    struct piece rook = board->squares[from_rank * 8];
-    rook.has_moved = true;
-    board->squares[from_rank * 8 + 7] = (struct piece){PIECE_WHITE, PIECE_NONE, false};
-    board->squares[from_rank * 8 + 5] = rook;
+    attack_map_update(position, map, attack_map_affected(position, changed), 1);
   }
-  board->current_color = board->current_color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
 }
 
-bool board_in_check(const struct board *board, enum piece_color color)
+void board_unmake_move(struct position *position, const struct undo *undo)
+{
+  unmake_move(position, NULL, undo);
+}
+
+void board_unmake_move_mapped(struct position *position, struct attack_map *map, const struct undo *undo)
+{
+  unmake_move(position, map, undo);
+}
+
+bool board_is_square_attacked(const struct position *position, int square, enum piece_color color)
+{
+  uint64_t occupied = position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK];
+  return (attackers_to(position, square, occupied) & position->colors[color]) != 0;
+}
+
+bool board_in_check(const struct position *position, enum piece_color color)
+{
+  enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  return board_is_square_attacked(position, position->king_squares[color], other_color);
+}
+
+struct check_info get_check_info(const struct position *position, enum piece_color color)
 {
   enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
-  for (int rank = 0; rank < 8; ++rank)
+  uint64_t occupied = position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK];
+  struct check_info info;
+  info.king_square = position->king_squares[color];
+  info.checkers = attackers_to(position, info.king_square, occupied) & position->colors[other_color];
+  if (info.checkers == 0)
+  {
+    info.check_mask = ~(uint64_t)0;
+  }
+  else if ((info.checkers & (info.checkers - 1)) == 0)
+  {
+    // single check, either capture the checker or block it
+    info.check_mask = info.checkers | attacks_between(info.king_square, bitboard_lsb(info.checkers));
+  }
+  else
+  {
+    // double check, only the king can move
+    info.check_mask = 0;
+  }
+  // enemy sliders that would attack our king if nothing was in between
+  uint64_t rooks = position->pieces[PIECE_ROOK] | position->pieces[PIECE_QUEEN];
+  uint64_t bishops = position->pieces[PIECE_BISHOP] | position->pieces[PIECE_QUEEN];
+  uint64_t snipers = ((attacks_rook(info.king_square, 0) & rooks) | (attacks_bishop(info.king_square, 0) & bishops)) & position->colors[other_color];
+  info.pinned = 0;
+  while (snipers != 0)
   {
-    for (int file = 0; file < 8; ++file)
+    int sniper = bitboard_pop_lsb(&snipers);
+    uint64_t blockers = attacks_between(info.king_square, sniper) & occupied;
+    if (blockers != 0 && (blockers & (blockers - 1)) == 0)
     {
-      struct piece piece = board->squares[rank * 8 + file];
-      if (piece.type != PIECE_NONE && piece.color == other_color)
-      {
-        // found piece of other color, check whether it attacks our king
-        struct move moves[32];
-        int move_count = board_get_pseudo_moves(board, rank, file, moves, false);
-        for (int i = 0; i < move_count; ++i)
-        {
-          if (board->squares[moves[i].rank * 8 + moves[i].file].type == PIECE_KING)
-          {
-            // move would capture our king, so we're in check
-            return true;
-          }
-        }
-      }
+      // exactly one piece in between, if it is ours it cannot leave the line
+      info.pinned |= blockers & position->colors[color];
     }
   }
-  return false;
+  return info;
 }
 
-bool are_moves_possible(struct board *board, enum piece_color color)
+int get_legal_moves(struct position *position, const struct check_info *info, int square, struct piece piece, struct move moves[32], enum move_kind kind)
 {
-  for (int rank = 0; rank < 8; ++rank)
+  int move_count = 0;
+  if (piece.type == PIECE_KING)
+  {
+    add_king_moves(position, info, piece.color, kind, moves, &move_count);
+    return move_count;
+  }
+  if (piece.type == PIECE_PAWN)
   {
-    for (int file = 0; file < 8; ++file)
+    add_pawn_moves(position, info, BITBOARD_SQUARE(square), piece.color, kind, moves, &move_count);
+    if (kind != MOVES_QUIETS)
     {
-      struct piece piece = board->squares[rank * 8 + file];
-      if (piece.type == PIECE_NONE || piece.color != color)
-      {
-        continue;
-      }
-      struct move moves[32];
-      int move_count = board_get_legal_moves(board, rank, file, moves);
-      if (move_count > 0)
+      add_legal_en_passant(position, BITBOARD_SQUARE(square), piece.color, moves, &move_count);
+    }
+    return move_count;
+  }
+  uint64_t allowed = info->check_mask;
+  if (info->pinned & BITBOARD_SQUARE(square))
+  {
+    allowed &= attacks_line(info->king_square, square);
+  }
+  struct move pseudo_moves[32];
+  int pseudo_move_count = get_piece_moves(position, square, piece, pseudo_moves, kind);
+  for (int i = 0; i < pseudo_move_count; ++i)
+  {
+    if (allowed & BITBOARD_SQUARE(move_get_to(pseudo_moves[i])))
+    {
+      moves[move_count++] = pseudo_moves[i];
+    }
+  }
+  return move_count;
+}
+
+static inline __attribute__((always_inline)) int generate(struct position *position, enum piece_color color, enum move_kind kind, struct move_list *list)
+{
+  struct check_info info = get_check_info(position, color);
+  list->count = 0;
+  if (info.check_mask == 0)
+  {
+    // double check, only the king can move
+    add_king_moves(position, &info, color, kind, list->moves, &list->count);
+    return list->count;
+  }
+  uint64_t pawns = position->pieces[PIECE_PAWN] & position->colors[color];
+  add_pawn_moves(position, &info, pawns, color, kind, list->moves, &list->count);
+  if (kind != MOVES_QUIETS)
+  {
+    add_legal_en_passant(position, pawns, color, list->moves, &list->count);
+  }
+  for (int i = 0; i < PIECE_ORDER_COUNT; ++i)
+  {
+    // walk the pieces of each type directly, the type is known without looking at the mailbox
+    uint64_t pieces = position->pieces[piece_order[i]] & position->colors[color];
+    while (pieces != 0)
+    {
+      int square = bitboard_pop_lsb(&pieces);
+      list->count += get_legal_moves(position, &info, square, (struct piece){color, piece_order[i]}, &list->moves[list->count], kind);
+    }
+  }
+  add_king_moves(position, &info, color, kind, list->moves, &list->count);
+  return list->count;
+}
+
+int generate_white(struct position *position, enum move_kind kind, struct move_list *list)
+{
+  return generate(position, PIECE_WHITE, kind, list);
+}
+
+int generate_black(struct position *position, enum move_kind kind, struct move_list *list)
+{
+  return generate(position, PIECE_BLACK, kind, list);
+}
+
+bool board_has_legal_move(struct position *position, enum piece_color color)
+{
+  enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  struct check_info info = get_check_info(position, color);
+  uint64_t own = position->colors[color];
+  uint64_t occupied = position->colors[PIECE_WHITE] | position->colors[PIECE_BLACK];
+  // the king usually has a free square and only needs an attack test for each,
+  // castling never matters since it needs the square next to the king as well
+  uint64_t without_king = occupied & ~BITBOARD_SQUARE(info.king_square);
+  uint64_t targets = attacks_king(info.king_square) & ~own;
+  while (targets != 0)
+  {
+    if ((attackers_to(position, bitboard_pop_lsb(&targets), without_king) & position->colors[other_color]) == 0)
+    {
+      return true;
+    }
+  }
+  if (info.check_mask == 0)
+  {
+    // double check, only the king can move
+    return false;
+  }
+  // pieces that are not pinned may go anywhere they reach that also deals with a check
+  uint64_t free = own & ~info.pinned;
+  uint64_t pawns = position->pieces[PIECE_PAWN] & free;
+  uint64_t pushes = pawn_push(pawns, color) & ~occupied;
+  uint64_t doubles = pawn_double_push(pushes, color, ~occupied);
+  uint64_t captures = (pawn_captures_left(pawns, color) | pawn_captures_right(pawns, color)) & position->colors[other_color];
+  if ((pushes | doubles | captures) & info.check_mask)
+  {
+    return true;
+  }
+  for (int i = 0; i < PIECE_ORDER_COUNT; ++i)
+  {
+    uint64_t pieces = position->pieces[piece_order[i]] & free;
+    while (pieces != 0)
+    {
+      int square = bitboard_pop_lsb(&pieces);
+      if (piece_targets[piece_order[i]](square, occupied) & ~own & info.check_mask)
       {
         return true;
       }
     }
   }
+  // pinned pieces and en passant are rare, leave them to the full generator
+  uint64_t rest = own & info.pinned & ~position->pieces[PIECE_KING];
+  if (position->en_passant_possible)
+  {
+    int square = position->en_passant_rank * BOARD_SIZE + position->en_passant_file;
+    rest |= attacks_pawn(other_color, square) & position->pieces[PIECE_PAWN] & own;
+  }
+  while (rest != 0)
+  {
+    int square = bitboard_pop_lsb(&rest);
+    struct move moves[32];
+    if (get_legal_moves(position, &info, square, position->squares[square], moves, MOVES_ALL) > 0)
+    {
+      return true;
+    }
+  }
   return false;
 }
 
-enum game_state board_status(struct board *board, enum piece_color color)
+enum game_state board_status(struct position *position, const struct history *history, enum piece_color color)
 {
-  if (are_moves_possible(board, color))
+  if (!board_has_legal_move(position, color))
+  {
+    return board_in_check(position, color) ? STATE_MATE : STATE_DRAW;
+  }
+  if (position->halfmove_clock >= 100)
   {
-    return STATE_OK;
+    // fifty moves by each side without a capture or pawn move
+    return STATE_DRAW;
   }
-  if (board_in_check(board, color))
+  if (history != NULL && board_is_repetition(position, history, 3))
   {
-    return STATE_MATE;
+    return STATE_DRAW;
   }
-  return STATE_DRAW;
+  return STATE_OK;
 }
 
-int board_get_legal_moves(const struct board *board, int rank, int file, struct move moves[32])
+void board_history_init(struct history *history, const struct position *position)
 {
-  struct move pseudo_moves[32];
-  enum piece_color current_color = board->squares[rank * 8 + file].color;
-  int pseudo_move_count = board_get_pseudo_moves(board, rank, file, pseudo_moves, true);
-  int move_count = 0;
-  for (int i = 0; i < pseudo_move_count; ++i)
+  history->count = 0;
+  history->oldest = 0;
+  board_history_push(history, position);
+}
+
+void board_history_push(struct history *history, const struct position *position)
+{
+  history->keys[history->count++ % HISTORY_SIZE] = position->key;
+  if (history->count - history->oldest > HISTORY_SIZE)
   {
-    struct board new_board;
-    memcpy(&new_board, board, sizeof(struct board));
-    board_make_move(&new_board, rank, file, &pseudo_moves[i]);
-    if (!board_in_check(&new_board, current_color))
+    history->oldest = history->count - HISTORY_SIZE;
+  }
+}
+
+void board_history_pop(struct history *history)
+{
+  --history->count;
+  if (history->oldest > history->count)
+  {
+    history->oldest = history->count;
+  }
+}
+
+bool board_is_repetition(const struct position *position, const struct history *history, int times)
+{
+  // only positions since the last capture or pawn move can be the same, and
+  // only every second one of them has the same side to move
+  int back = position->halfmove_clock;
+  if (back > history->count - 1 - history->oldest)
+  {
+    // anything older has been overwritten
+    back = history->count - 1 - history->oldest;
+  }
+  int seen = 1;
+  for (int i = 2; i <= back; i += 2)
+  {
+    if (history->keys[(history->count - 1 - i) % HISTORY_SIZE] == position->key && ++seen >= times)
     {
-      moves[move_count++] = pseudo_moves[i];
+      return true;
     }
   }
-  return move_count;
+  return false;
+}
+
+int board_get_legal_moves(struct position *position, int rank, int file, struct move moves[32])
+{
+  int square = rank * BOARD_SIZE + file;
+  struct check_info info = get_check_info(position, position->squares[square].color);
+  return get_legal_moves(position, &info, square, position->squares[square], moves, MOVES_ALL);
+}
+
+int board_generate_moves(struct position *position, enum piece_color color, struct move_list *list)
+{
+  return board_generate(position, color, MOVES_ALL, list);
+}
+
+int board_generate(struct position *position, enum piece_color color, enum move_kind kind, struct move_list *list)
+{
+  // the side is looked at once here, the instances never branch on it
+  return color == PIECE_WHITE ? generate_white(position, kind, list) : generate_black(position, kind, list);
+}
+
+bool board_is_legal_move(struct position *position, struct move move)
+{
+  struct piece piece = position->squares[move_get_from(move)];
+  if (piece.type == PIECE_NONE || piece.color != position->current_color)
+  {
+    return false;
+  }
+  struct move moves[32];
+  int move_count = board_get_legal_moves(position, move_get_from(move) / BOARD_SIZE, move_get_from(move) % BOARD_SIZE, moves);
+  for (int i = 0; i < move_count; ++i)
+  {
+    if (moves[i].data == move.data)
+    {
+      return true;
+    }
+  }
+  return false;
 }
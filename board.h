@@ -1,8 +1,8 @@
 #ifndef BOARD_H
 #define BOARD_H
 
-#include <SDL3/SDL.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #define BOARD_SIZE 8
 
@@ -23,25 +23,48 @@ enum piece_type
   PIECE_NONE,
 };
 
+// packed into a single byte, so the whole mailbox fits in one cache line
 struct piece
 {
-  enum piece_color color;
-  enum piece_type type;
-  bool has_moved;
+  unsigned char color : 1;
+  unsigned char type : 3;
 };
 
-struct board
+// castling rights in `position.castling`, shifted left by 2 for black
+enum castling_flag
 {
-  SDL_Renderer *renderer;
-  int x;
-  int y;
-  int square_width;
-  int square_height;
+  CASTLING_LEFT = 1,
+  CASTLING_RIGHT = 2,
+};
+
+#define CASTLING_FLAG(flag, color) ((flag) << (2 * (color)))
+#define CASTLING_ALL 15
+
+// which squares each side attacks and by how many of its pieces, optional and
+// kept next to the position by whoever wants it, see `board_make_move_mapped`
+struct attack_map
+{
+  uint64_t attacked[2];
+  unsigned char counts[2][BOARD_SIZE * BOARD_SIZE];
+};
+
+struct position
+{
+  // derived view of `pieces` and `colors`, used for drawing and per-square lookups
   struct piece squares[BOARD_SIZE * BOARD_SIZE];
+  // occupancy per piece type and per color
+  uint64_t pieces[PIECE_NONE];
+  uint64_t colors[2];
+  unsigned char king_squares[2];
   bool en_passant_possible;
   int en_passant_rank;
   int en_passant_file;
   enum piece_color current_color;
+  unsigned char castling;
+  // plies since the last capture or pawn move, not part of the key
+  int halfmove_clock;
+  // zobrist key of everything above, kept up to date by `board_make_move`
+  uint64_t key;
 };
 
 enum move_type
@@ -52,13 +75,102 @@ enum move_type
   MOVE_EN_PASSANT,
   MOVE_CASTLE_LEFT,
   MOVE_CASTLE_RIGHT,
+  MOVE_PROMOTE_KNIGHT,
+  MOVE_PROMOTE_BISHOP,
+  MOVE_PROMOTE_ROOK,
+  MOVE_PROMOTE_QUEEN,
+  MOVE_CAPTURE_PROMOTE_KNIGHT,
+  MOVE_CAPTURE_PROMOTE_BISHOP,
+  MOVE_CAPTURE_PROMOTE_ROOK,
+  MOVE_CAPTURE_PROMOTE_QUEEN,
 };
 
+// packed into 16 bits: the from square in bits 0-5, the to square in
+// bits 6-11 and the move type in bits 12-15
 struct move
 {
-  int rank;
-  int file;
-  enum move_type type;
+  uint16_t data;
+};
+
+static inline struct move move_make(int from, int to, enum move_type type)
+{
+  return (struct move){(uint16_t)(from | to << 6 | type << 12)};
+}
+
+static inline int move_get_from(struct move move)
+{
+  return move.data & 63;
+}
+
+static inline int move_get_to(struct move move)
+{
+  return move.data >> 6 & 63;
+}
+
+static inline enum move_type move_get_type(struct move move)
+{
+  return move.data >> 12;
+}
+
+static inline bool move_is_capture(struct move move)
+{
+  enum move_type type = move_get_type(move);
+  return type == MOVE_CAPTURE || type == MOVE_EN_PASSANT || type >= MOVE_CAPTURE_PROMOTE_KNIGHT;
+}
+
+static inline bool move_is_promotion(struct move move)
+{
+  return move_get_type(move) >= MOVE_PROMOTE_KNIGHT;
+}
+
+static inline enum piece_type move_get_promotion(struct move move)
+{
+  static const enum piece_type promotions[4] = {PIECE_KNIGHT, PIECE_BISHOP, PIECE_ROOK, PIECE_QUEEN};
+  return promotions[(move_get_type(move) - MOVE_PROMOTE_KNIGHT) & 3];
+}
+
+// no legal position has more than 218 moves
+#define MAX_MOVES 256
+
+// all legal moves of one side
+struct move_list
+{
+  struct move moves[MAX_MOVES];
+  int count;
+};
+
+// which moves `board_generate` produces, en passant and capturing promotions
+// count as captures, castling and other promotions as quiet moves
+enum move_kind
+{
+  MOVES_ALL,
+  MOVES_CAPTURES,
+  MOVES_QUIETS,
+};
+
+// everything `board_unmake_move` needs to take back a move
+struct undo
+{
+  struct move move;
+  struct piece captured;
+  bool en_passant_possible;
+  unsigned char castling;
+  int en_passant_rank;
+  int en_passant_file;
+  int halfmove_clock;
+  uint64_t key;
+};
+
+// keys of the positions of a game, the newest one last, as a ring big enough
+// to cover everything since the last capture or pawn move under the fifty move rule
+#define HISTORY_SIZE 128
+
+struct history
+{
+  uint64_t keys[HISTORY_SIZE];
+  int count;
+  // index of the oldest key not yet overwritten, popping does not bring older ones back
+  int oldest;
 };
 
 enum game_state
@@ -68,16 +180,34 @@ enum game_state
   STATE_DRAW,
 };
 
-struct board board_init(SDL_Renderer *renderer, int x, int y, int width, int height);
-void board_draw_texture(const struct board *board, SDL_Texture *texture, int rank, int file);
-void board_draw(const struct board *board, SDL_Texture *textures[12]);
+struct position board_init(void);
+// reads a position in forsyth-edwards notation, returns false if it is malformed
+bool board_from_fen(struct position *position, const char *fen);
+uint64_t board_compute_key(const struct position *position);
+void board_attack_map_init(struct attack_map *map, const struct position *position);
+
+int board_get_pseudo_moves(const struct position *position, int rank, int file, struct move moves[32], bool castling);
+void board_make_move(struct position *position, struct move move, struct undo *undo);
+void board_unmake_move(struct position *position, const struct undo *undo);
+// same as the two above, also keeping `map` up to date for the position
+void board_make_move_mapped(struct position *position, struct attack_map *map, struct move move, struct undo *undo);
+void board_unmake_move_mapped(struct position *position, struct attack_map *map, const struct undo *undo);
 
-int board_get_pseudo_moves(const struct board *board, int rank, int file, struct move moves[32], bool castling);
-void board_make_move(struct board *board, int from_rank, int from_file, const struct move *move);
+bool board_is_square_attacked(const struct position *position, int square, enum piece_color color);
+bool board_in_check(const struct position *position, enum piece_color color);
+// cheaper than generating everything when only the existence of a move matters
+bool board_has_legal_move(struct position *position, enum piece_color color);
+// `history` may be NULL, then repetitions are not detected
+enum game_state board_status(struct position *position, const struct history *history, enum piece_color color);
 
-bool board_in_check(const struct board *board, enum piece_color color);
-enum game_state board_status(struct board *board, enum piece_color color);
+void board_history_init(struct history *history, const struct position *position);
+void board_history_push(struct history *history, const struct position *position);
+void board_history_pop(struct history *history);
+bool board_is_repetition(const struct position *position, const struct history *history, int times);
 
-int board_get_legal_moves(const struct board *board, int rank, int file, struct move moves[32]);
+int board_get_legal_moves(struct position *position, int rank, int file, struct move moves[32]);
+int board_generate_moves(struct position *position, enum piece_color color, struct move_list *list);
+int board_generate(struct position *position, enum piece_color color, enum move_kind kind, struct move_list *list);
+bool board_is_legal_move(struct position *position, struct move move);
 
 #endif
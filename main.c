@@ -5,6 +5,7 @@
 #include <SDL3/SDL.h>
 #include "board.h"
 #include "texture.h"
+#include "view.h"
 
 #define WINDOW_SIZE 800
 #define SELECTOR_THICKNESS 5
@@ -40,9 +41,9 @@ void free_sound(struct sound *sound)
   SDL_free(sound->data);
 }
 
-void draw_selector(const struct board *board, int rank, int file);
-int board_get_rank(const struct board *board, float y);
-int board_get_file(const struct board *board, float x);
+void draw_selector(const struct view *view, int rank, int file, SDL_Color color);
+int view_get_rank(const struct view *view, float y);
+int view_get_file(const struct view *view, float x);
 
 int main(int argc, char *argv[])
 {
@@ -59,12 +60,19 @@ int main(int argc, char *argv[])
   struct sound move_sound = load_sound(audioDevice, "./assets/move.wav");
   struct sound capture_sound = load_sound(audioDevice, "./assets/capture.wav");
   SDL_Texture *move_texture = load_texture(renderer, "./assets/move.png");
-  struct board board = board_init(renderer, 0, 0, WINDOW_SIZE, WINDOW_SIZE);
+  struct position position = board_init();
+  // answers the check question below without scanning the board, undo restores it along with the position
+  struct attack_map attack_map;
+  board_attack_map_init(&attack_map, &position);
+  struct view view = view_init(renderer, &position, 0, 0, WINDOW_SIZE, WINDOW_SIZE);
   bool selected = false;
   int selected_rank = 0;
   int selected_file = 0;
-  struct board *board_history = malloc(sizeof(struct board) * 256);
-  int last_board = 0;
+  struct position *position_history = malloc(sizeof(struct position) * 256);
+  struct attack_map *attack_map_history = malloc(sizeof(struct attack_map) * 256);
+  int last_position = 0;
+  struct history history;
+  board_history_init(&history, &position);
   bool ended = false;
   SDL_Texture *piece_textures[12];
   piece_textures[0] = load_texture(renderer, "./assets/white/bishop.png");
@@ -90,10 +98,12 @@ int main(int argc, char *argv[])
         running = false;
         break;
       case SDL_EVENT_KEY_DOWN:
-        if (event.key.key == SDLK_U && last_board > 0)
+        if (event.key.key == SDLK_U && last_position > 0)
         {
           ended = false;
-          memcpy(&board, &board_history[--last_board], sizeof(struct board));
+          memcpy(&position, &position_history[--last_position], sizeof(struct position));
+          memcpy(&attack_map, &attack_map_history[last_position], sizeof(struct attack_map));
+          board_history_pop(&history);
         }
         break;
       case SDL_EVENT_MOUSE_BUTTON_UP:
@@ -101,12 +111,12 @@ int main(int argc, char *argv[])
         {
           break;
         }
-        int rank = board_get_rank(&board, event.button.y);
-        int file = board_get_rank(&board, event.button.x);
+        int rank = view_get_rank(&view, event.button.y);
+        int file = view_get_rank(&view, event.button.x);
         if (!selected)
         {
-          struct piece piece = board.squares[rank * BOARD_SIZE + file];
-          if (piece.type == PIECE_NONE || piece.color != board.current_color)
+          struct piece piece = position.squares[rank * BOARD_SIZE + file];
+          if (piece.type == PIECE_NONE || piece.color != position.current_color)
           {
             // cannot select empty square or opponent piece
             break;
@@ -124,11 +134,16 @@ int main(int argc, char *argv[])
           break;
         }
         struct move moves[32];
-        int move_count = board_get_legal_moves(&board, selected_rank, selected_file, moves);
+        int move_count = board_get_legal_moves(&position, selected_rank, selected_file, moves);
         const struct move *move = NULL;
         for (int i = 0; i < move_count; ++i)
         {
-          if (moves[i].rank == rank && moves[i].file == file)
+          if (move_is_promotion(moves[i]) && move_get_promotion(moves[i]) != PIECE_QUEEN)
+          {
+            // always promote to a queen
+            continue;
+          }
+          if (move_get_to(moves[i]) == rank * BOARD_SIZE + file)
           {
             move = &moves[i];
             break;
@@ -137,8 +152,8 @@ int main(int argc, char *argv[])
         if (move == NULL)
         {
           // not a valid move, try selecting
-          struct piece piece = board.squares[rank * BOARD_SIZE + file];
-          if (piece.type == PIECE_NONE || piece.color != board.current_color)
+          struct piece piece = position.squares[rank * BOARD_SIZE + file];
+          if (piece.type == PIECE_NONE || piece.color != position.current_color)
           {
             // cannot select empty square or opponent piece
             break;
@@ -149,7 +164,7 @@ int main(int argc, char *argv[])
           selected_file = file;
           break;
         }
-        if (move->type == MOVE_CAPTURE || move->type == MOVE_EN_PASSANT)
+        if (move_is_capture(*move))
         {
           play_sound(&capture_sound);
         }
@@ -158,13 +173,16 @@ int main(int argc, char *argv[])
           play_sound(&move_sound);
         }
         // move piece to new location
-        memcpy(&board_history[last_board++], &board, sizeof(struct board));
-        board_make_move(&board, selected_rank, selected_file, move);
+        memcpy(&attack_map_history[last_position], &attack_map, sizeof(struct attack_map));
+        memcpy(&position_history[last_position++], &position, sizeof(struct position));
+        struct undo undo;
+        board_make_move_mapped(&position, &attack_map, *move, &undo);
+        board_history_push(&history, &position);
         selected = false;
-        enum game_state status = board_status(&board, board.current_color);
+        enum game_state status = board_status(&position, &history, position.current_color);
         if (status == STATE_MATE)
         {
-          if (board.current_color == PIECE_WHITE)
+          if (position.current_color == PIECE_WHITE)
           {
             printf("Black won!\n");
           }
@@ -184,15 +202,20 @@ int main(int argc, char *argv[])
     }
     SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
     SDL_RenderClear(renderer);
-    board_draw(&board, piece_textures);
+    view_draw(&view, piece_textures);
+    int king_square = position.king_squares[position.current_color];
+    if (attack_map.attacked[position.current_color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE] & ((uint64_t)1 << king_square))
+    {
+      draw_selector(&view, king_square / BOARD_SIZE, king_square % BOARD_SIZE, (SDL_Color){255, 0, 0, 255});
+    }
     if (selected)
     {
-      draw_selector(&board, selected_rank, selected_file);
+      draw_selector(&view, selected_rank, selected_file, (SDL_Color){0, 255, 0, 255});
       struct move moves[32];
-      int move_count = board_get_legal_moves(&board, selected_rank, selected_file, moves);
+      int move_count = board_get_legal_moves(&position, selected_rank, selected_file, moves);
       for (int i = 0; i < move_count; ++i)
       {
-        board_draw_texture(&board, move_texture, moves[i].rank, moves[i].file);
+        view_draw_texture(&view, move_texture, move_get_to(moves[i]) / BOARD_SIZE, move_get_to(moves[i]) % BOARD_SIZE);
       }
     }
     SDL_RenderPresent(renderer);
@@ -205,25 +228,25 @@ int main(int argc, char *argv[])
   SDL_Quit();
 }
 
-void draw_selector(const struct board *board, int rank, int file)
+void draw_selector(const struct view *view, int rank, int file, SDL_Color color)
 {
   SDL_FRect dest;
-  dest.x = (board->x + file * board->square_width) / SELECTOR_THICKNESS;
-  dest.y = (board->y + rank * board->square_height) / SELECTOR_THICKNESS;
-  dest.w = board->square_width / SELECTOR_THICKNESS;
-  dest.h = board->square_height / SELECTOR_THICKNESS;
-  SDL_SetRenderDrawColor(board->renderer, 0, 255, 0, 255);
-  SDL_SetRenderScale(board->renderer, SELECTOR_THICKNESS, SELECTOR_THICKNESS);
-  SDL_RenderRect(board->renderer, &dest);
-  SDL_SetRenderScale(board->renderer, 1, 1);
+  dest.x = (view->x + file * view->square_width) / SELECTOR_THICKNESS;
+  dest.y = (view->y + rank * view->square_height) / SELECTOR_THICKNESS;
+  dest.w = view->square_width / SELECTOR_THICKNESS;
+  dest.h = view->square_height / SELECTOR_THICKNESS;
+  SDL_SetRenderDrawColor(view->renderer, color.r, color.g, color.b, color.a);
+  SDL_SetRenderScale(view->renderer, SELECTOR_THICKNESS, SELECTOR_THICKNESS);
+  SDL_RenderRect(view->renderer, &dest);
+  SDL_SetRenderScale(view->renderer, 1, 1);
 }
 
-int board_get_rank(const struct board *board, float y)
+int view_get_rank(const struct view *view, float y)
 {
-  return floor((y - board->y) / board->square_height);
+  return floor((y - view->y) / view->square_height);
 }
 
-int board_get_file(const struct board *board, float x)
+int view_get_file(const struct view *view, float x)
 {
-  return floor((x - board->x) / board->square_width);
+  return floor((x - view->x) / view->square_width);
 }
@@ -0,0 +1,483 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include "attacks.h"
+#include "board.h"
+#include "timer.h"
+
+#define START_FEN "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+struct perft_test
+{
+  const char *name;
+  const char *fen;
+  int depth;
+  uint64_t nodes;
+};
+
+// reference counts from the chess programming wiki
+static const struct perft_test tests[] = {
+  {"start", START_FEN, 6, 119060324},
+  {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 4085603},
+  {"position 3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 6, 11030083},
+  {"position 4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4, 422333},
+  {"position 4 mirrored", "r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1", 4, 422333},
+  {"position 5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4, 2103487},
+  {"position 6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594},
+};
+
+// the tree is cut this many plies below the root, every position there is one task
+#define DEFAULT_SPLIT_DEPTH 2
+
+// subtree counts shared by all threads without locks, each entry stores its
+// key xored with its data so an entry torn by two writers racing just misses
+struct cache_entry
+{
+  uint64_t check;
+  // node count above the low 8 bits, depth in them
+  uint64_t data;
+};
+
+// the first entry of a bucket keeps the deepest subtree, the second the latest
+struct cache
+{
+  struct cache_entry (*buckets)[2];
+  uint64_t mask;
+  size_t size;
+};
+
+struct cache_stats
+{
+  uint64_t probes;
+  uint64_t hits;
+};
+
+struct task
+{
+  struct position position;
+  int depth;
+  // index of the root move this subtree belongs to
+  int root;
+  uint64_t nodes;
+  struct cache_stats stats;
+};
+
+// a worker takes tasks from the end of its own range and steals from the
+// start of the others' once it runs dry, no tasks are added while running
+struct worker
+{
+  pthread_t thread;
+  pthread_mutex_t lock;
+  int begin;
+  int end;
+  struct pool *pool;
+};
+
+struct pool
+{
+  struct task *tasks;
+  int task_count;
+  int task_capacity;
+  struct worker *workers;
+  int worker_count;
+};
+
+static int thread_count = 1;
+static int split_depth = DEFAULT_SPLIT_DEPTH;
+static struct cache cache;
+static struct cache_stats cache_totals;
+// set by -m, every task keeps an attack map up to date and checks it against a fresh one
+static bool attack_maps;
+
+static void cache_init(size_t megabytes)
+{
+  // largest power of two number of buckets that fits
+  size_t count = 1;
+  while (count * 2 * sizeof(*cache.buckets) <= megabytes * 1024 * 1024)
+  {
+    count *= 2;
+  }
+  cache.buckets = calloc(count, sizeof(*cache.buckets));
+  cache.mask = count - 1;
+  cache.size = count * sizeof(*cache.buckets);
+}
+
+static bool cache_probe(uint64_t key, int depth, uint64_t *nodes)
+{
+  struct cache_entry *bucket = cache.buckets[key & cache.mask];
+  for (int i = 0; i < 2; ++i)
+  {
+    uint64_t check = __atomic_load_n(&bucket[i].check, __ATOMIC_RELAXED);
+    uint64_t data = __atomic_load_n(&bucket[i].data, __ATOMIC_RELAXED);
+    if ((check ^ data) == key && (int)(data & 0xff) == depth)
+    {
+      *nodes = data >> 8;
+      return true;
+    }
+  }
+  return false;
+}
+
+static void cache_store(uint64_t key, int depth, uint64_t nodes)
+{
+  struct cache_entry *bucket = cache.buckets[key & cache.mask];
+  uint64_t data = nodes << 8 | (uint64_t)depth;
+  int slot = (int)(__atomic_load_n(&bucket[0].data, __ATOMIC_RELAXED) & 0xff) <= depth ? 0 : 1;
+  __atomic_store_n(&bucket[slot].check, key ^ data, __ATOMIC_RELAXED);
+  __atomic_store_n(&bucket[slot].data, data, __ATOMIC_RELAXED);
+}
+
+static void check_attack_map(const struct position *position, const struct attack_map *map)
+{
+  struct attack_map fresh;
+  board_attack_map_init(&fresh, position);
+  if (memcmp(&fresh, map, sizeof(struct attack_map)) != 0)
+  {
+    fprintf(stderr, "attack map out of date in position with key %016llx\n", (unsigned long long)position->key);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static uint64_t perft(struct position *position, struct attack_map *map, int depth, struct cache_stats *stats)
+{
+  if (depth == 0)
+  {
+    return 1;
+  }
+  if (map != NULL)
+  {
+    check_attack_map(position, map);
+  }
+  // the last two plies are cheaper to count again than to look up
+  bool cached = cache.buckets != NULL && depth >= 2;
+  uint64_t nodes = 0;
+  if (cached)
+  {
+    ++stats->probes;
+    if (cache_probe(position->key, depth, &nodes))
+    {
+      ++stats->hits;
+      return nodes;
+    }
+  }
+  struct move_list list;
+  board_generate_moves(position, position->current_color, &list);
+  if (depth == 1)
+  {
+    // leaves do not have to be made
+    return list.count;
+  }
+  for (int i = 0; i < list.count; ++i)
+  {
+    struct undo undo;
+    board_make_move_mapped(position, map, list.moves[i], &undo);
+    nodes += perft(position, map, depth - 1, stats);
+    board_unmake_move_mapped(position, map, &undo);
+  }
+  if (cached)
+  {
+    cache_store(position->key, depth, nodes);
+  }
+  return nodes;
+}
+
+static void add_task(struct pool *pool, const struct position *position, int depth, int root)
+{
+  if (pool->task_count == pool->task_capacity)
+  {
+    pool->task_capacity = pool->task_capacity == 0 ? 1024 : pool->task_capacity * 2;
+    pool->tasks = realloc(pool->tasks, sizeof(struct task) * pool->task_capacity);
+  }
+  // each task gets its own copy, workers never touch the same position
+  struct task *task = &pool->tasks[pool->task_count++];
+  task->position = *position;
+  task->depth = depth;
+  task->root = root;
+  task->nodes = 0;
+  task->stats = (struct cache_stats){0, 0};
+}
+
+static void split(struct pool *pool, struct position *position, int depth, int plies, int root)
+{
+  if (plies == 0 || depth <= 1)
+  {
+    add_task(pool, position, depth, root);
+    return;
+  }
+  struct move_list list;
+  board_generate_moves(position, position->current_color, &list);
+  for (int i = 0; i < list.count; ++i)
+  {
+    struct undo undo;
+    board_make_move(position, list.moves[i], &undo);
+    split(pool, position, depth - 1, plies - 1, root);
+    board_unmake_move(position, &undo);
+  }
+}
+
+static bool take_task(struct worker *worker, bool steal, struct task **task)
+{
+  pthread_mutex_lock(&worker->lock);
+  bool found = worker->begin < worker->end;
+  if (found)
+  {
+    *task = &worker->pool->tasks[steal ? worker->begin++ : --worker->end];
+  }
+  pthread_mutex_unlock(&worker->lock);
+  return found;
+}
+
+static void *run_worker(void *argument)
+{
+  struct worker *worker = argument;
+  struct pool *pool = worker->pool;
+  int index = worker - pool->workers;
+  struct task *task;
+  while (true)
+  {
+    bool found = take_task(worker, false, &task);
+    for (int i = 1; !found && i < pool->worker_count; ++i)
+    {
+      found = take_task(&pool->workers[(index + i) % pool->worker_count], true, &task);
+    }
+    if (!found)
+    {
+      // everything is taken, nothing new will show up
+      return NULL;
+    }
+    struct attack_map map;
+    if (attack_maps)
+    {
+      board_attack_map_init(&map, &task->position);
+    }
+    task->nodes = perft(&task->position, attack_maps ? &map : NULL, task->depth, &task->stats);
+  }
+}
+
+static uint64_t perft_parallel(struct position *position, int depth, const struct move_list *root_moves, uint64_t *root_nodes)
+{
+  struct pool pool = {0};
+  for (int i = 0; i < root_moves->count; ++i)
+  {
+    struct undo undo;
+    board_make_move(position, root_moves->moves[i], &undo);
+    split(&pool, position, depth - 1, split_depth - 1, i);
+    board_unmake_move(position, &undo);
+    root_nodes[i] = 0;
+  }
+  pool.worker_count = thread_count;
+  pool.workers = malloc(sizeof(struct worker) * pool.worker_count);
+  for (int i = 0; i < pool.worker_count; ++i)
+  {
+    struct worker *worker = &pool.workers[i];
+    pthread_mutex_init(&worker->lock, NULL);
+    worker->begin = (int)((int64_t)pool.task_count * i / pool.worker_count);
+    worker->end = (int)((int64_t)pool.task_count * (i + 1) / pool.worker_count);
+    worker->pool = &pool;
+  }
+  for (int i = 1; i < pool.worker_count; ++i)
+  {
+    pthread_create(&pool.workers[i].thread, NULL, run_worker, &pool.workers[i]);
+  }
+  // the calling thread is a worker as well
+  run_worker(&pool.workers[0]);
+  for (int i = 1; i < pool.worker_count; ++i)
+  {
+    pthread_join(pool.workers[i].thread, NULL);
+  }
+  uint64_t total = 0;
+  for (int i = 0; i < pool.task_count; ++i)
+  {
+    root_nodes[pool.tasks[i].root] += pool.tasks[i].nodes;
+    total += pool.tasks[i].nodes;
+    cache_totals.probes += pool.tasks[i].stats.probes;
+    cache_totals.hits += pool.tasks[i].stats.hits;
+  }
+  for (int i = 0; i < pool.worker_count; ++i)
+  {
+    pthread_mutex_destroy(&pool.workers[i].lock);
+  }
+  free(pool.workers);
+  free(pool.tasks);
+  return total;
+}
+
+static uint64_t perft_root(struct position *position, int depth)
+{
+  struct move_list list;
+  uint64_t root_nodes[MAX_MOVES];
+  board_generate_moves(position, position->current_color, &list);
+  return depth == 1 ? (uint64_t)list.count : perft_parallel(position, depth, &list, root_nodes);
+}
+
+static void print_cache_stats(void)
+{
+  if (cache.buckets == NULL)
+  {
+    return;
+  }
+  double rate = cache_totals.probes == 0 ? 0 : 100.0 * cache_totals.hits / cache_totals.probes;
+  printf("hash: %zu MB in %llu entries, %llu probes, %llu hits, %.1f%% hit rate\n", cache.size / (1024 * 1024), (unsigned long long)(cache.mask + 1) * 2,
+    (unsigned long long)cache_totals.probes, (unsigned long long)cache_totals.hits, rate);
+}
+
+static void move_to_string(struct move move, char string[6])
+{
+  // same as the uci protocol, e.g. e2e4 or e7e8q
+  static const char promotions[] = "bknpqr";
+  int from = move_get_from(move);
+  int to = move_get_to(move);
+  string[0] = 'a' + from % BOARD_SIZE;
+  string[1] = '8' - from / BOARD_SIZE;
+  string[2] = 'a' + to % BOARD_SIZE;
+  string[3] = '8' - to / BOARD_SIZE;
+  string[4] = move_is_promotion(move) ? promotions[move_get_promotion(move)] : '\0';
+  string[5] = '\0';
+}
+
+static void divide(struct position *position, int depth)
+{
+  struct move_list list;
+  board_generate_moves(position, position->current_color, &list);
+  uint64_t root_nodes[MAX_MOVES];
+  double start = timer_now();
+  uint64_t total = perft_parallel(position, depth, &list, root_nodes);
+  double seconds = timer_now() - start;
+  for (int i = 0; i < list.count; ++i)
+  {
+    char string[6];
+    move_to_string(list.moves[i], string);
+    printf("%s: %llu\n", string, (unsigned long long)root_nodes[i]);
+  }
+  printf("\nmoves: %d\nnodes: %llu\ntime: %.3fs\nnps: %.0f\n", list.count, (unsigned long long)total, seconds, total / seconds);
+  print_cache_stats();
+}
+
+static bool play(struct position *position, const char *string, struct undo *undo)
+{
+  struct move_list list;
+  board_generate_moves(position, position->current_color, &list);
+  for (int i = 0; i < list.count; ++i)
+  {
+    char other[6];
+    move_to_string(list.moves[i], other);
+    if (strcmp(string, other) == 0)
+    {
+      board_make_move(position, list.moves[i], undo);
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool check_repetition(void)
+{
+  // 1.e4 Nf6 2.Nf3 Ng8 3.Ng1 Nf6 4.Nf3 Ng8 5.Ng1, the position after 1.e4
+  // comes up for the third time with the last move and not any earlier
+  static const char *const line[] = {"e2e4", "g8f6", "g1f3", "f6g8", "f3g1", "g8f6", "g1f3", "f6g8", "f3g1"};
+  static const int count = sizeof(line) / sizeof(line[0]);
+  struct position position;
+  board_from_fen(&position, START_FEN);
+  struct history history;
+  board_history_init(&history, &position);
+  int draw_ply = 0;
+  for (int i = 0; i < count && draw_ply == 0; ++i)
+  {
+    struct undo undo;
+    if (!play(&position, line[i], &undo))
+    {
+      break;
+    }
+    board_history_push(&history, &position);
+    if (board_status(&position, &history, position.current_color) == STATE_DRAW)
+    {
+      draw_ply = i + 1;
+    }
+  }
+  bool ok = draw_ply == count;
+  printf("%-4s %-20s draw expected at ply %d got %d\n", ok ? "ok" : "FAIL", "repetition", count, draw_ply);
+  return ok;
+}
+
+static bool run_suite(void)
+{
+  bool passed = true;
+  uint64_t total = 0;
+  double total_seconds = 0;
+  for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+  {
+    struct position position;
+    board_from_fen(&position, tests[i].fen);
+    double start = timer_now();
+    uint64_t nodes = perft_root(&position, tests[i].depth);
+    double seconds = timer_now() - start;
+    bool ok = nodes == tests[i].nodes;
+    passed = passed && ok;
+    total += nodes;
+    total_seconds += seconds;
+    printf("%-4s %-20s depth %d expected %10llu got %10llu %8.3fs %12.0f nps\n", ok ? "ok" : "FAIL", tests[i].name, tests[i].depth,
+      (unsigned long long)tests[i].nodes, (unsigned long long)nodes, seconds, nodes / seconds);
+  }
+  passed = check_repetition() && passed;
+  printf("\n%s with %d threads, %llu nodes in %.3fs, %.0f nps\n", passed ? "all passed" : "FAILED", thread_count, (unsigned long long)total, total_seconds, total / total_seconds);
+  print_cache_stats();
+  return passed;
+}
+
+int main(int argc, char *argv[])
+{
+  thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int option;
+  int hash_megabytes = 0;
+  while ((option = getopt(argc, argv, "t:s:H:m")) != -1)
+  {
+    if (option == 't')
+    {
+      thread_count = atoi(optarg);
+    }
+    else if (option == 's')
+    {
+      split_depth = atoi(optarg);
+    }
+    else if (option == 'H')
+    {
+      hash_megabytes = atoi(optarg);
+    }
+    else if (option == 'm')
+    {
+      attack_maps = true;
+    }
+    else
+    {
+      thread_count = 0;
+    }
+  }
+  if (thread_count < 1 || split_depth < 1 || hash_megabytes < 0)
+  {
+    fprintf(stderr, "usage: %s [-t threads] [-s split depth] [-H hash megabytes] [-m] [depth [fen]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (hash_megabytes > 0)
+  {
+    cache_init(hash_megabytes);
+  }
+  attacks_init();
+  printf("attacks: %s\n\n", attacks_backend());
+  if (optind == argc)
+  {
+    return run_suite() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  int depth = atoi(argv[optind]);
+  const char *fen = optind + 1 < argc ? argv[optind + 1] : START_FEN;
+  struct position position;
+  if (depth < 1 || !board_from_fen(&position, fen))
+  {
+    fprintf(stderr, "usage: %s [-t threads] [-s split depth] [-H hash megabytes] [-m] [depth [fen]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  divide(&position, depth);
+  return EXIT_SUCCESS;
+}
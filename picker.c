@@ -0,0 +1,128 @@
+#include <stddef.h>
+#include "picker.h"
+
+// most valuable victim first, least valuable attacker to break ties
+static const int piece_values[PIECE_NONE + 1] = {
+  [PIECE_PAWN] = 1,
+  [PIECE_KNIGHT] = 3,
+  [PIECE_BISHOP] = 3,
+  [PIECE_ROOK] = 5,
+  [PIECE_QUEEN] = 9,
+  [PIECE_KING] = 100,
+  [PIECE_NONE] = 0,
+};
+
+static int capture_score(const struct position *position, struct move move)
+{
+  int victim = move_get_type(move) == MOVE_EN_PASSANT ? PIECE_PAWN : position->squares[move_get_to(move)].type;
+  int attacker = position->squares[move_get_from(move)].type;
+  int score = piece_values[victim] * 16 - piece_values[attacker];
+  if (move_is_promotion(move))
+  {
+    score += piece_values[move_get_promotion(move)] * 16;
+  }
+  return score;
+}
+
+static bool is_hash_move(const struct picker *picker, struct move move)
+{
+  return move.data == picker->hash_move.data;
+}
+
+static bool is_killer(const struct picker *picker, struct move move)
+{
+  return move.data == picker->killers[0].data || move.data == picker->killers[1].data;
+}
+
+void picker_init(struct picker *picker, struct position *position, struct move hash_move, const struct move killers[2])
+{
+  picker->position = position;
+  picker->stage = PICKER_HASH;
+  picker->hash_move = hash_move;
+  picker->killers[0] = killers != NULL ? killers[0] : (struct move){0};
+  picker->killers[1] = killers != NULL ? killers[1] : (struct move){0};
+  if (picker->killers[1].data == picker->killers[0].data)
+  {
+    picker->killers[1] = (struct move){0};
+  }
+  picker->index = 0;
+}
+
+bool picker_next(struct picker *picker, struct move *move)
+{
+  switch (picker->stage)
+  {
+  case PICKER_HASH:
+    picker->stage = PICKER_CAPTURES_INIT;
+    if (picker->hash_move.data != 0 && board_is_legal_move(picker->position, picker->hash_move))
+    {
+      *move = picker->hash_move;
+      return true;
+    }
+    // fall through
+  case PICKER_CAPTURES_INIT:
+    board_generate(picker->position, picker->position->current_color, MOVES_CAPTURES, &picker->list);
+    picker->index = 0;
+    picker->stage = PICKER_CAPTURES;
+    // fall through
+  case PICKER_CAPTURES:
+    while (picker->index < picker->list.count)
+    {
+      // selection sort, most captures are cut off long before the list is sorted
+      int best = picker->index;
+      int best_score = capture_score(picker->position, picker->list.moves[best]);
+      for (int i = picker->index + 1; i < picker->list.count; ++i)
+      {
+        int score = capture_score(picker->position, picker->list.moves[i]);
+        if (score > best_score)
+        {
+          best = i;
+          best_score = score;
+        }
+      }
+      struct move next = picker->list.moves[best];
+      picker->list.moves[best] = picker->list.moves[picker->index];
+      picker->list.moves[picker->index++] = next;
+      if (!is_hash_move(picker, next))
+      {
+        *move = next;
+        return true;
+      }
+    }
+    picker->index = 0;
+    picker->stage = PICKER_KILLERS;
+    // fall through
+  case PICKER_KILLERS:
+    while (picker->index < 2)
+    {
+      struct move killer = picker->killers[picker->index++];
+      if (killer.data != 0 && !is_hash_move(picker, killer) && !move_is_capture(killer) && board_is_legal_move(picker->position, killer))
+      {
+        *move = killer;
+        return true;
+      }
+    }
+    picker->stage = PICKER_QUIETS_INIT;
+    // fall through
+  case PICKER_QUIETS_INIT:
+    board_generate(picker->position, picker->position->current_color, MOVES_QUIETS, &picker->list);
+    picker->index = 0;
+    picker->stage = PICKER_QUIETS;
+    // fall through
+  case PICKER_QUIETS:
+    while (picker->index < picker->list.count)
+    {
+      struct move next = picker->list.moves[picker->index++];
+      if (!is_hash_move(picker, next) && !is_killer(picker, next))
+      {
+        *move = next;
+        return true;
+      }
+    }
+    picker->stage = PICKER_DONE;
+    // fall through
+  case PICKER_DONE:
+    break;
+  }
+  return false;
+}
@@ -0,0 +1,34 @@
+#ifndef PICKER_H
+#define PICKER_H
+
+#include "board.h"
+
+enum picker_stage
+{
+  PICKER_HASH,
+  PICKER_CAPTURES_INIT,
+  PICKER_CAPTURES,
+  PICKER_KILLERS,
+  PICKER_QUIETS_INIT,
+  PICKER_QUIETS,
+  PICKER_DONE,
+};
+
+// hands out the legal moves of a position one at a time: the hash move,
+// then captures, then killer moves, then the remaining quiet moves,
+// generating each stage only once it is reached
+struct picker
+{
+  struct position *position;
+  enum picker_stage stage;
+  struct move hash_move;
+  struct move killers[2];
+  struct move_list list;
+  int index;
+};
+
+// `hash_move` and `killers` may be zero, or moves that are not legal here
+void picker_init(struct picker *picker, struct position *position, struct move hash_move, const struct move killers[2]);
+bool picker_next(struct picker *picker, struct move *move);
+
+#endif
@@ -0,0 +1,117 @@
+#include <stddef.h>
+#include "bitboard.h"
+#include "picker.h"
+#include "search.h"
+
+static const int piece_values[PIECE_NONE] = {
+  [PIECE_PAWN] = 100,
+  [PIECE_KNIGHT] = 300,
+  [PIECE_BISHOP] = 300,
+  [PIECE_ROOK] = 500,
+  [PIECE_QUEEN] = 900,
+  [PIECE_KING] = 0,
+};
+
+static int evaluate(const struct position *position)
+{
+  // material, from the point of view of the side to move
+  enum piece_color color = position->current_color;
+  enum piece_color other_color = color == PIECE_WHITE ? PIECE_BLACK : PIECE_WHITE;
+  int score = 0;
+  for (int type = 0; type < PIECE_NONE; ++type)
+  {
+    score += piece_values[type] * (bitboard_count(position->pieces[type] & position->colors[color]) - bitboard_count(position->pieces[type] & position->colors[other_color]));
+  }
+  return score;
+}
+
+static void store_killer(struct search *search, int ply, struct move move)
+{
+  if (move_is_capture(move) || search->killers[ply][0].data == move.data)
+  {
+    return;
+  }
+  search->killers[ply][1] = search->killers[ply][0];
+  search->killers[ply][0] = move;
+}
+
+static int alpha_beta(struct search *search, struct position *position, int depth, int ply, int alpha, int beta)
+{
+  ++search->nodes;
+  if (depth == 0 || ply == SEARCH_MAX_PLY - 1)
+  {
+    return evaluate(position);
+  }
+  struct picker picker;
+  picker_init(&picker, position, (struct move){0}, search->killers[ply]);
+  struct move move;
+  bool any_move = false;
+  while (picker_next(&picker, &move))
+  {
+    any_move = true;
+    struct undo undo;
+    board_make_move(position, move, &undo);
+    int score = -alpha_beta(search, position, depth - 1, ply + 1, -beta, -alpha);
+    board_unmake_move(position, &undo);
+    if (score >= beta)
+    {
+      store_killer(search, ply, move);
+      return beta;
+    }
+    if (score > alpha)
+    {
+      alpha = score;
+    }
+  }
+  if (!any_move)
+  {
+    return board_in_check(position, position->current_color) ? -SCORE_MATE + ply : 0;
+  }
+  return alpha;
+}
+
+void search_init(struct search *search)
+{
+  for (int ply = 0; ply < SEARCH_MAX_PLY; ++ply)
+  {
+    search->killers[ply][0] = (struct move){0};
+    search->killers[ply][1] = (struct move){0};
+  }
+  search->nodes = 0;
+}
+
+int search_position(struct search *search, struct position *position, int depth, struct move *best)
+{
+  *best = (struct move){0};
+  int best_score = 0;
+  for (int iteration = 1; iteration <= depth; ++iteration)
+  {
+    // the best move of the last iteration is tried first
+    struct picker picker;
+    picker_init(&picker, position, *best, search->killers[0]);
+    struct move move;
+    int alpha = -SCORE_MATE;
+    struct move iteration_best = {0};
+    ++search->nodes;
+    while (picker_next(&picker, &move))
+    {
+      struct undo undo;
+      board_make_move(position, move, &undo);
+      int score = -alpha_beta(search, position, iteration - 1, 1, -SCORE_MATE, -alpha);
+      board_unmake_move(position, &undo);
+      if (iteration_best.data == 0 || score > alpha)
+      {
+        alpha = score;
+        iteration_best = move;
+      }
+    }
+    if (iteration_best.data == 0)
+    {
+      // mated or stalemated already
+      return board_in_check(position, position->current_color) ? -SCORE_MATE : 0;
+    }
+    *best = iteration_best;
+    best_score = alpha;
+  }
+  return best_score;
+}
@@ -0,0 +1,24 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdint.h>
+#include "board.h"
+
+#define SEARCH_MAX_PLY 64
+// scores at least this far from zero are mates, closer ones are found first
+#define SCORE_MATE 100000
+
+// plain fixed depth alpha-beta on material, deterministic so its node count
+// can tell whether a change altered what the search does
+struct search
+{
+  struct move killers[SEARCH_MAX_PLY][2];
+  uint64_t nodes;
+};
+
+void search_init(struct search *search);
+// searches every depth up to `depth`, returns the score for the side to move
+// and sets `best` to zero if there is no legal move
+int search_position(struct search *search, struct position *position, int depth, struct move *best);
+
+#endif
@@ -0,0 +1,53 @@
+#include "view.h"
+
+struct view view_init(SDL_Renderer *renderer, const struct position *position, int x, int y, int width, int height)
+{
+  struct view view;
+  view.renderer = renderer;
+  view.position = position;
+  view.x = x;
+  view.y = y;
+  view.square_width = width / BOARD_SIZE;
+  view.square_height = height / BOARD_SIZE;
+  return view;
+}
+
+void view_draw_texture(const struct view *view, SDL_Texture *texture, int rank, int file)
+{
+  SDL_FRect dest;
+  dest.x = view->x + file * view->square_width;
+  dest.y = view->y + rank * view->square_height;
+  dest.w = view->square_width;
+  dest.h = view->square_height;
+  SDL_RenderTexture(view->renderer, texture, NULL, &dest);
+}
+
+void view_draw(const struct view *view, SDL_Texture *textures[12])
+{
+  for (int rank = 0; rank < BOARD_SIZE; ++rank)
+  {
+    for (int file = 0; file < BOARD_SIZE; ++file)
+    {
+      if (((rank + file) & 1) == 0)
+      {
+        SDL_SetRenderDrawColor(view->renderer, 255, 255, 153, 255);
+      }
+      else
+      {
+        SDL_SetRenderDrawColor(view->renderer, 102, 51, 0, 255);
+      }
+      SDL_FRect square;
+      square.x = view->x + file * view->square_width;
+      square.y = view->y + rank * view->square_height;
+      square.w = view->square_width;
+      square.h = view->square_height;
+      SDL_RenderFillRect(view->renderer, &square);
+      struct piece piece = view->position->squares[rank * BOARD_SIZE + file];
+      if (piece.type != PIECE_NONE)
+      {
+        SDL_Texture *texture = textures[piece.color * 6 + piece.type];
+        view_draw_texture(view, texture, rank, file);
+      }
+    }
+  }
+}
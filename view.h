@@ -0,0 +1,21 @@
+#ifndef VIEW_H
+#define VIEW_H
+
+#include <SDL3/SDL.h>
+#include "board.h"
+
+struct view
+{
+  SDL_Renderer *renderer;
+  const struct position *position;
+  int x;
+  int y;
+  int square_width;
+  int square_height;
+};
+
+struct view view_init(SDL_Renderer *renderer, const struct position *position, int x, int y, int width, int height);
+void view_draw_texture(const struct view *view, SDL_Texture *texture, int rank, int file);
+void view_draw(const struct view *view, SDL_Texture *textures[12]);
+
+#endif